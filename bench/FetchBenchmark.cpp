@@ -0,0 +1,408 @@
+#include <CurlManager.hpp>
+#include <Utilities.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+
+/**
+ * @brief Returns a monotonic timestamp in microseconds.
+ */
+static long long now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Returns the CPU time used by the process so far, user and system, in microseconds.
+ */
+static long long cpu_us()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/**
+ * @brief Raises the open file limit to the hard limit if `needed` descriptors do not fit.
+ */
+static void reserve_descriptors(int needed)
+{
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) != 0 || files.rlim_cur >= static_cast<rlim_t>(needed))
+    {
+        return;
+    }
+
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+    if (files.rlim_cur < static_cast<rlim_t>(needed))
+    {
+        std::fprintf(stderr, "Only %llu file descriptors are available, the largest level needs about %d\n",
+            static_cast<unsigned long long>(files.rlim_cur), needed);
+    }
+}
+
+/**
+ * @brief The poll timeout used while driving transfers, in milliseconds.
+ */
+static const int POLL_TIMEOUT_MS = 1000;
+
+/**
+ * @brief How long a serial fetch from the loopback server may take before it counts as a
+ *        stall, well under the poll timeout that a missed wake-up would wait out.
+ */
+static const double STALL_MS = POLL_TIMEOUT_MS / 2.0;
+
+/**
+ * @struct BenchmarkRun
+ * @brief What was measured while fetching at one concurrency level.
+ */
+struct BenchmarkRun
+{
+    int concurrency = 0;
+    int completed = 0;
+    int failed = 0;
+    long long wire_bytes = 0;
+    long long decoded_bytes = 0;
+    long long elapsed_us = 0;
+    long long cpu_us = 0;          /**< Process CPU time, user and system, spent on the run */
+    std::vector<long long> latencies_us;
+};
+
+/**
+ * @brief Returns a percentile of sorted latencies, in milliseconds.
+ */
+static double percentile_ms(const std::vector<long long>& sorted_us, double percentile)
+{
+    if (sorted_us.empty())
+    {
+        return 0;
+    }
+
+    size_t index = static_cast<size_t>(percentile * (sorted_us.size() - 1) + 0.5);
+    return sorted_us[index] / 1000.0;
+}
+
+/**
+ * @brief Fetches `requests` URLs through the curl_manager, keeping `concurrency` of them in flight.
+ *
+ * A new request is submitted as each one completes, so latencies are measured from the moment
+ * a request could start rather than including time spent queued behind the others.
+ */
+static BenchmarkRun run_level(const std::vector<std::string>& urls, int requests, int concurrency)
+{
+    BenchmarkRun run;
+    run.concurrency = concurrency;
+    run.latencies_us.reserve(requests);
+
+    curl_manager.set_max_in_flight(concurrency);
+
+    int submitted = 0;
+    std::function<void()> submit_next;
+
+    submit_next = [&]()
+    {
+        const std::string& url = urls[submitted % urls.size()];
+        long long submitted_us = now_us();
+        submitted++;
+
+        curl_manager.submit(url.c_str(), [&, submitted_us](FetchResult& result)
+        {
+            run.latencies_us.push_back(now_us() - submitted_us);
+            run.completed++;
+            run.wire_bytes += result.wire_bytes;
+            run.decoded_bytes += result.decoded_bytes;
+
+            if (result.fetch_code != FetchCode::NO_FETCH_ERROR)
+            {
+                run.failed++;
+            }
+            delete result.html_content;
+
+            if (submitted < requests)
+            {
+                submit_next();
+            }
+        });
+    };
+
+    long long started_us = now_us();
+    long long started_cpu_us = cpu_us();
+
+    while (submitted < std::min(requests, concurrency))
+    {
+        submit_next();
+    }
+
+    while (!curl_manager.idle())
+    {
+        curl_manager.poll(POLL_TIMEOUT_MS);
+    }
+
+    run.elapsed_us = now_us() - started_us;
+    run.cpu_us = cpu_us() - started_cpu_us;
+    std::sort(run.latencies_us.begin(), run.latencies_us.end());
+    return run;
+}
+
+/**
+ * @brief Fetches pages one at a time on every backend and checks none waited out the poll timeout.
+ *
+ * With a single transfer in flight, each completion must start the next queued transfer right
+ * away; a backend that sleeps in its poll instead shows up as latencies near the timeout.
+ * The server's configured latency is overridden, so the check holds whatever it shapes.
+ *
+ * @return true if no backend stalled, false otherwise.
+ */
+static bool check_stalls(const std::vector<std::string>& urls, const std::vector<FetchBackend>& backends)
+{
+    std::vector<std::string> unshaped;
+    for (const std::string& url : urls)
+    {
+        unshaped.push_back(url + "?latency_ms=0");
+    }
+
+    bool stalled = false;
+    for (FetchBackend backend : backends)
+    {
+        curl_manager.set_backend(backend);
+
+        BenchmarkRun run = run_level(unshaped, 20, 1);
+        double slowest_ms = percentile_ms(run.latencies_us, 1.0);
+        if (slowest_ms >= STALL_MS)
+        {
+            std::fprintf(stderr, "The %s backend stalled: a serial fetch took %.0f ms\n",
+                backend == FetchBackend::SOCKET_BACKEND ? "epoll" : "poll", slowest_ms);
+            stalled = true;
+        }
+    }
+
+    return !stalled;
+}
+
+/**
+ * @brief Parses a comma separated list of concurrency levels.
+ */
+static std::vector<int> parse_levels(const std::string& list)
+{
+    std::vector<int> levels;
+    std::istringstream stream(list);
+    std::string level;
+
+    while (std::getline(stream, level, ','))
+    {
+        if (std::atoi(level.c_str()) > 0)
+        {
+            levels.push_back(std::atoi(level.c_str()));
+        }
+    }
+
+    return levels;
+}
+
+/**
+ * @brief Prints the command line options.
+ */
+static void usage()
+{
+    std::printf(
+        "Usage: FetchBenchmark [options]\n"
+        "  --base URL          Base URL of the FixtureServer (default http://127.0.0.1:8080)\n"
+        "  --fixtures DIR      Directory served by the FixtureServer, used to list the URLs (default ./fixtures)\n"
+        "  --requests N        Requests made at each concurrency level (default 1000)\n"
+        "  --concurrency LIST  Comma separated concurrency levels (default 1,4,16,64)\n"
+        "  --attempts N        Attempts per request, including retries (default 1)\n"
+        "  --socket            Use the epoll socket backend instead of curl_multi_poll\n"
+        "  --backends          Run every level on both backends, to compare their CPU per transfer\n"
+        "  --http2             Ask for HTTP/2 (the FixtureServer itself only speaks HTTP/1.1)\n"
+        "  --adaptive N        Let the adaptive limiter tune concurrency, up to N per host; levels cap the total\n"
+        "  --timings           Print the libcurl phase timings of every transfer at the end\n");
+}
+
+int main(int argc, char** argv)
+{
+    std::string base = "http://127.0.0.1:8080";
+    std::string fixtures = "./fixtures";
+    int requests = 1000;
+    std::vector<int> levels = { 1, 4, 16, 64 };
+    int attempts = 1;
+    bool timings = false;
+    int adaptive_host_limit = 0;
+    std::vector<FetchBackend> backends = { FetchBackend::POLL_BACKEND };
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+
+        if (option == "--socket")
+        {
+            backends = { FetchBackend::SOCKET_BACKEND };
+            continue;
+        }
+        if (option == "--backends")
+        {
+            backends = { FetchBackend::POLL_BACKEND, FetchBackend::SOCKET_BACKEND };
+            continue;
+        }
+        if (option == "--http2")
+        {
+            curl_manager.set_http2(true);
+            continue;
+        }
+        if (option == "--timings")
+        {
+            timings = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 1;
+        }
+
+        std::string value = argv[++i];
+
+        if (option == "--base")
+        {
+            base = value;
+        }
+        else if (option == "--fixtures")
+        {
+            fixtures = value;
+        }
+        else if (option == "--requests")
+        {
+            requests = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (option == "--concurrency")
+        {
+            levels = parse_levels(value);
+        }
+        else if (option == "--attempts")
+        {
+            attempts = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (option == "--adaptive")
+        {
+            adaptive_host_limit = std::max(1, std::atoi(value.c_str()));
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    while (!base.empty() && base.back() == '/')
+    {
+        base.pop_back();
+    }
+
+    std::vector<std::string> urls;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(fixtures, error))
+    {
+        if (entry.is_regular_file())
+        {
+            urls.push_back(base + "/" + std::filesystem::relative(entry.path(), fixtures).generic_string());
+        }
+    }
+    std::sort(urls.begin(), urls.end());
+
+    if (urls.empty())
+    {
+        std::fprintf(stderr, "No fixtures found in %s\n", fixtures.c_str());
+        return 1;
+    }
+
+    curl_manager.set_retry_policy(attempts, 100, 1000);
+
+    // One socket per transfer in flight, plus a margin for the rest of the process
+    if (levels.empty())
+    {
+        usage();
+        return 1;
+    }
+    reserve_descriptors(*std::max_element(levels.begin(), levels.end()) + 64);
+
+    for (FetchBackend& backend : backends)
+    {
+        if (backend == FetchBackend::SOCKET_BACKEND && !curl_manager.set_backend(backend))
+        {
+            std::fprintf(stderr, "The socket backend is not available, using curl_multi_poll\n");
+            backend = FetchBackend::POLL_BACKEND;
+        }
+    }
+    curl_manager.set_backend(backends.front());
+
+    // Warm up the connection pool and DNS cache, so the first level is not penalised
+    run_level(urls, std::min<int>(requests, 16), 4);
+
+    if (!check_stalls(urls, backends))
+    {
+        return 1;
+    }
+    curl_manager.get_transfer_stats().clear();
+
+    std::printf("%zu fixtures, %d requests per level\n\n", urls.size(), requests);
+    std::printf("%11s %8s %10s %10s %10s %12s %9s %9s %9s %9s %7s\n",
+        "concurrency", "backend", "pages/s", "MB/s wire", "MB/s body", "cpu us/xfer", "p50 ms", "p90 ms", "p99 ms", "max ms", "failed");
+
+    for (int concurrency : levels)
+    {
+        for (FetchBackend backend : backends)
+        {
+            curl_manager.set_backend(backend);
+
+            if (adaptive_host_limit > 0)
+            {
+                curl_manager.set_max_in_flight(concurrency);
+                curl_manager.set_adaptive_concurrency(true, concurrency, adaptive_host_limit);
+            }
+
+            BenchmarkRun run = run_level(urls, requests, concurrency);
+            double seconds = run.elapsed_us / 1000000.0;
+
+            std::printf("%11d %8s %10.1f %10.2f %10.2f %12.1f %9.2f %9.2f %9.2f %9.2f %7d\n",
+                run.concurrency,
+                backend == FetchBackend::SOCKET_BACKEND ? "epoll" : "poll",
+                run.completed / seconds,
+                run.wire_bytes / seconds / 1e6,
+                run.decoded_bytes / seconds / 1e6,
+                static_cast<double>(run.cpu_us) / std::max(1, run.completed),
+                percentile_ms(run.latencies_us, 0.50),
+                percentile_ms(run.latencies_us, 0.90),
+                percentile_ms(run.latencies_us, 0.99),
+                percentile_ms(run.latencies_us, 1.0),
+                run.failed);
+
+            if (adaptive_host_limit > 0)
+            {
+                std::string host = url_host(urls.front());
+                std::printf("%11s adaptive limits: %d overall, %d for %s\n", "",
+                    curl_manager.get_concurrency_limit(), curl_manager.get_host_concurrency_limit(host), host.c_str());
+            }
+        }
+    }
+
+    if (timings)
+    {
+        std::printf("\n");
+        std::fflush(stdout);
+        curl_manager.get_transfer_stats().dump(std::cout);
+    }
+
+    return 0;
+}
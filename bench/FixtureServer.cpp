@@ -0,0 +1,625 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+/**
+ * @struct ServerOptions
+ * @brief How the fixture server shapes its responses.
+ */
+struct ServerOptions
+{
+    int port = 8080;
+    std::string root = "./fixtures";
+    long latency_ms = 0;           /**< Delay before each response is sent */
+    long jitter_ms = 0;            /**< Random extra delay, up to this many milliseconds */
+    long bandwidth = 0;            /**< Body bytes per second sent on each connection, or 0 for no cap */
+    bool chunked = false;          /**< Whether bodies are sent with Transfer-Encoding: chunked */
+    size_t chunk_size = 16384;     /**< The size of each chunk or paced write */
+    double error_rate = 0;         /**< The fraction of requests answered with 503 */
+    double reset_rate = 0;         /**< The fraction of requests answered by resetting the connection */
+    int capacity = 0;              /**< Requests handled at once before others queue, or 0 for no limit */
+    unsigned seed = 1;             /**< Seeds the error injection, so runs are repeatable */
+};
+
+/**
+ * @class FixtureServer
+ * @brief A small HTTP/1.1 server serving a directory of fixtures over loopback.
+ *
+ * Every file under the root directory is loaded into memory at startup and served at its
+ * relative path, so the server itself never waits on the disk. Connections are kept alive
+ * and each one is served by its own thread, with a small stack so that ten thousand slow
+ * connections fit comfortably. Latency, bandwidth, chunked encoding and failures
+ * are shaped by the ServerOptions. A capacity makes requests beyond it queue for a free
+ * worker, so latency rises under load like a saturated origin. A single request can override them with the query
+ * parameters `latency_ms` and `status`, for example `/page.html?latency_ms=200&status=500`.
+ */
+class FixtureServer
+{
+    public:
+
+        FixtureServer(const ServerOptions& options);
+        ~FixtureServer();
+
+        int run();
+
+    private:
+
+        ServerOptions options;
+        std::unordered_map<std::string, std::string> fixtures;
+        std::atomic<unsigned> connections{0};
+
+        std::mutex workers_lock;
+        std::condition_variable worker_freed;
+        int busy_workers = 0;
+
+        void load_fixtures();
+        void serve_connection(int client, unsigned seed);
+        bool start_connection_thread(int client, unsigned seed);
+        bool send_all(int client, const char* data, size_t length);
+        bool send_body(int client, const std::string& body);
+        void acquire_worker();
+        void release_worker();
+
+        static void* connection_thread(void* argument);
+        static std::string content_type(const std::string& path);
+        static std::string query_parameter(const std::string& query, const char* name);
+};
+
+
+/**
+ * @brief Constructs a new FixtureServer object.
+ *
+ * @param options How the server shapes its responses.
+ */
+FixtureServer::FixtureServer(const ServerOptions& options)
+{
+    this->options = options;
+}
+
+/**
+ * @brief Destructor for the FixtureServer class.
+ */
+FixtureServer::~FixtureServer()
+{
+}
+
+/**
+ * @brief Loads every file under the root directory into memory.
+ */
+void FixtureServer::load_fixtures()
+{
+    std::error_code error;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(this->options.root, error))
+    {
+        if (!entry.is_regular_file())
+        {
+            continue;
+        }
+
+        std::ifstream file(entry.path(), std::ios::binary);
+        std::ostringstream contents;
+        contents << file.rdbuf();
+
+        std::string path = "/" + std::filesystem::relative(entry.path(), this->options.root).generic_string();
+        this->fixtures[path] = contents.str();
+    }
+
+    if (error)
+    {
+        std::fprintf(stderr, "Failed to read fixture directory: %s\n", this->options.root.c_str());
+    }
+}
+
+/**
+ * @brief Listens on the loopback interface and serves connections until killed.
+ *
+ * @return int The exit status of the server.
+ */
+int FixtureServer::run()
+{
+    this->load_fixtures();
+
+    // Every connection holds a descriptor, so allow as many as the hard limit permits
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max)
+    {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(this->options.port));
+
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+    {
+        std::fprintf(stderr, "Failed to listen on port %d: %s\n", this->options.port, std::strerror(errno));
+        close(listener);
+        return 1;
+    }
+
+    std::printf("Serving %zu fixtures from %s on http://127.0.0.1:%d/\n",
+        this->fixtures.size(), this->options.root.c_str(), this->options.port);
+    std::fflush(stdout);
+
+    while (true)
+    {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0)
+        {
+            continue;
+        }
+
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        unsigned seed = this->options.seed + this->connections++;
+        if (!this->start_connection_thread(client, seed))
+        {
+            std::fprintf(stderr, "Failed to start a thread for connection %u\n", this->connections.load());
+            close(client);
+        }
+    }
+}
+
+/**
+ * @struct ConnectionStart
+ * @brief What a new connection thread needs to start serving.
+ */
+struct ConnectionStart
+{
+    FixtureServer* server;
+    int client;
+    unsigned seed;
+};
+
+/**
+ * @brief Serves a connection on a detached thread with a 256 KB stack.
+ *
+ * The default stack of 8 MB per thread would reserve 80 GB of address space for ten thousand
+ * connections, which hits the overcommit limits of many machines.
+ *
+ * @return bool Whether the thread was started.
+ */
+bool FixtureServer::start_connection_thread(int client, unsigned seed)
+{
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, 256 * 1024);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+    ConnectionStart* start = new ConnectionStart{ this, client, seed };
+    pthread_t thread;
+    int error = pthread_create(&thread, &attributes, connection_thread, start);
+    pthread_attr_destroy(&attributes);
+
+    if (error != 0)
+    {
+        delete start;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief The entry point of a connection thread.
+ */
+void* FixtureServer::connection_thread(void* argument)
+{
+    ConnectionStart* start = static_cast<ConnectionStart*>(argument);
+    start->server->serve_connection(start->client, start->seed);
+    delete start;
+    return nullptr;
+}
+
+/**
+ * @brief Answers the requests of one connection until the client closes it.
+ *
+ * @param client The connected socket.
+ * @param seed Seeds the error injection of this connection.
+ */
+void FixtureServer::serve_connection(int client, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    std::string buffer;
+    char chunk[8192];
+
+    while (true)
+    {
+        // Read until the end of the request headers; GET requests carry no body
+        size_t header_end;
+        while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos)
+        {
+            ssize_t received = recv(client, chunk, sizeof(chunk), 0);
+            if (received <= 0)
+            {
+                close(client);
+                return;
+            }
+            buffer.append(chunk, received);
+        }
+
+        std::string head = buffer.substr(0, header_end);
+        buffer.erase(0, header_end + 4);
+
+        std::istringstream request_line(head.substr(0, head.find("\r\n")));
+        std::string method, target, version;
+        request_line >> method >> target >> version;
+
+        std::string lower_head = head;
+        std::transform(lower_head.begin(), lower_head.end(), lower_head.begin(), ::tolower);
+        bool keep_alive = version == "HTTP/1.1" ? lower_head.find("connection: close") == std::string::npos
+                                                : lower_head.find("connection: keep-alive") != std::string::npos;
+
+        size_t query_start = target.find('?');
+        std::string path = target.substr(0, query_start);
+        std::string query = query_start == std::string::npos ? "" : target.substr(query_start + 1);
+
+        // Shape the response
+        long delay_ms = this->options.latency_ms;
+        std::string latency = query_parameter(query, "latency_ms");
+        if (!latency.empty())
+        {
+            delay_ms = std::atol(latency.c_str());
+        }
+        if (this->options.jitter_ms > 0)
+        {
+            delay_ms += static_cast<long>(chance(random) * this->options.jitter_ms);
+        }
+
+        if (this->options.reset_rate > 0 && chance(random) < this->options.reset_rate)
+        {
+            // Closing with a zero linger time sends a reset instead of a clean shutdown
+            linger reset = { 1, 0 };
+            setsockopt(client, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+            close(client);
+            return;
+        }
+
+        this->acquire_worker();
+
+        if (delay_ms > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        }
+
+        int status = 200;
+        std::string forced_status = query_parameter(query, "status");
+        const std::string* body = nullptr;
+        std::string error_body;
+
+        auto found = this->fixtures.find(path == "/" ? "/index.html" : path);
+
+        if (!forced_status.empty())
+        {
+            status = std::atoi(forced_status.c_str());
+        }
+        else if (method != "GET" && method != "HEAD")
+        {
+            status = 405;
+        }
+        else if (this->options.error_rate > 0 && chance(random) < this->options.error_rate)
+        {
+            status = 503;
+        }
+        else if (found == this->fixtures.end())
+        {
+            status = 404;
+        }
+
+        if (status == 200 && found != this->fixtures.end())
+        {
+            body = &found->second;
+        }
+        else
+        {
+            error_body = "<html><body>" + std::to_string(status) + "</body></html>";
+            body = &error_body;
+        }
+
+        std::string headers = "HTTP/1.1 " + std::to_string(status) + (status == 200 ? " OK" : " Fixture") + "\r\n";
+        headers += "Content-Type: " + (body == &error_body ? std::string("text/html") : content_type(path)) + "\r\n";
+        if (status == 503)
+        {
+            headers += "Retry-After: 1\r\n";
+        }
+        if (this->options.chunked)
+        {
+            headers += "Transfer-Encoding: chunked\r\n";
+        }
+        else
+        {
+            headers += "Content-Length: " + std::to_string(body->size()) + "\r\n";
+        }
+        headers += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+        bool sent = this->send_all(client, headers.data(), headers.size()) &&
+                    (method == "HEAD" || this->send_body(client, *body));
+        this->release_worker();
+
+        if (!sent || !keep_alive)
+        {
+            close(client);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Waits for one of the `capacity` workers to be free and takes it.
+ */
+void FixtureServer::acquire_worker()
+{
+    if (this->options.capacity <= 0)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(this->workers_lock);
+    this->worker_freed.wait(guard, [this]() { return this->busy_workers < this->options.capacity; });
+    this->busy_workers++;
+}
+
+/**
+ * @brief Frees a worker taken by `acquire_worker`.
+ */
+void FixtureServer::release_worker()
+{
+    if (this->options.capacity <= 0)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(this->workers_lock);
+        this->busy_workers--;
+    }
+    this->worker_freed.notify_one();
+}
+
+/**
+ * @brief Sends a response body, chunked and paced to the bandwidth cap if configured.
+ *
+ * @return true if the body was sent, false if the connection failed.
+ */
+bool FixtureServer::send_body(int client, const std::string& body)
+{
+    size_t slice = this->options.chunk_size;
+    if (this->options.bandwidth > 0)
+    {
+        // Keep slices small enough that pacing stays smooth at low bandwidths
+        slice = std::min(slice, std::max<size_t>(1, this->options.bandwidth / 50));
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    size_t sent = 0;
+
+    while (sent < body.size())
+    {
+        size_t length = std::min(slice, body.size() - sent);
+
+        if (this->options.chunked)
+        {
+            char size_line[32];
+            int size_length = std::snprintf(size_line, sizeof(size_line), "%zx\r\n", length);
+            if (!this->send_all(client, size_line, size_length) ||
+                !this->send_all(client, body.data() + sent, length) ||
+                !this->send_all(client, "\r\n", 2))
+            {
+                return false;
+            }
+        }
+        else if (!this->send_all(client, body.data() + sent, length))
+        {
+            return false;
+        }
+
+        sent += length;
+
+        if (this->options.bandwidth > 0)
+        {
+            auto due = started + std::chrono::microseconds(static_cast<long long>(sent * 1000000.0 / this->options.bandwidth));
+            std::this_thread::sleep_until(due);
+        }
+    }
+
+    return !this->options.chunked || this->send_all(client, "0\r\n\r\n", 5);
+}
+
+/**
+ * @brief Writes a whole buffer to a socket.
+ *
+ * @return true if everything was written, false if the connection failed.
+ */
+bool FixtureServer::send_all(int client, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = send(client, data, length, MSG_NOSIGNAL);
+        if (written <= 0)
+        {
+            return false;
+        }
+
+        data += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Picks the Content-Type of a fixture from its extension.
+ */
+std::string FixtureServer::content_type(const std::string& path)
+{
+    std::string extension = std::filesystem::path(path).extension().string();
+
+    if (extension == ".html" || extension == ".htm")
+    {
+        return "text/html; charset=utf-8";
+    }
+    if (extension == ".txt")
+    {
+        return "text/plain; charset=utf-8";
+    }
+    if (extension == ".xhtml")
+    {
+        return "application/xhtml+xml";
+    }
+
+    return "application/octet-stream";
+}
+
+/**
+ * @brief Returns the value of a query parameter, or an empty string if it is absent.
+ */
+std::string FixtureServer::query_parameter(const std::string& query, const char* name)
+{
+    std::string key = std::string(name) + "=";
+    size_t start = 0;
+
+    while (start < query.size())
+    {
+        size_t end = query.find('&', start);
+        if (end == std::string::npos)
+        {
+            end = query.size();
+        }
+
+        if (query.compare(start, key.size(), key) == 0)
+        {
+            return query.substr(start + key.size(), end - start - key.size());
+        }
+
+        start = end + 1;
+    }
+
+    return "";
+}
+
+
+/**
+ * @brief Prints the command line options.
+ */
+static void usage()
+{
+    std::printf(
+        "Usage: FixtureServer [options]\n"
+        "  --port N           Port to listen on (default 8080)\n"
+        "  --root DIR         Directory of fixtures to serve (default ./fixtures)\n"
+        "  --latency-ms N     Delay before every response\n"
+        "  --jitter-ms N      Random extra delay of up to N ms\n"
+        "  --bandwidth N      Body bytes per second per connection\n"
+        "  --chunked          Send bodies with chunked transfer encoding\n"
+        "  --chunk-size N     Size of each chunk or paced write (default 16384)\n"
+        "  --error-rate P     Fraction of requests answered with 503\n"
+        "  --reset-rate P     Fraction of requests answered by resetting the connection\n"
+        "  --capacity N       Requests handled at once; the rest queue for a free worker\n"
+        "  --seed N           Seed for the error injection (default 1)\n");
+}
+
+int main(int argc, char** argv)
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    ServerOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (option == "--chunked")
+        {
+            options.chunked = true;
+            continue;
+        }
+
+        if (value == nullptr)
+        {
+            usage();
+            return 1;
+        }
+        i++;
+
+        if (option == "--port")
+        {
+            options.port = std::atoi(value);
+        }
+        else if (option == "--root")
+        {
+            options.root = value;
+        }
+        else if (option == "--latency-ms")
+        {
+            options.latency_ms = std::atol(value);
+        }
+        else if (option == "--jitter-ms")
+        {
+            options.jitter_ms = std::atol(value);
+        }
+        else if (option == "--bandwidth")
+        {
+            options.bandwidth = std::atol(value);
+        }
+        else if (option == "--chunk-size")
+        {
+            options.chunk_size = std::max<size_t>(1, std::atol(value));
+        }
+        else if (option == "--error-rate")
+        {
+            options.error_rate = std::atof(value);
+        }
+        else if (option == "--reset-rate")
+        {
+            options.reset_rate = std::atof(value);
+        }
+        else if (option == "--capacity")
+        {
+            options.capacity = std::atoi(value);
+        }
+        else if (option == "--seed")
+        {
+            options.seed = static_cast<unsigned>(std::atol(value));
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    FixtureServer server(options);
+    return server.run();
+}
@@ -0,0 +1,404 @@
+#include <HtmlTokenizer.hpp>
+#include <StructuralScanner.hpp>
+#include <Transport.hpp>
+#include <WebPage.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+/**
+ * @brief Returns a monotonic timestamp in microseconds.
+ */
+static long long now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @class PageTransport
+ * @brief Answers every fetch with the same in-memory page, so scraping measures parsing alone.
+ */
+class PageTransport : public Transport
+{
+    public:
+
+        PageTransport(const std::string& html) : html(html) {}
+
+        FetchResult fetch(const char* url) override
+        {
+            FetchResult result;
+            result.url = url;
+            result.html_content = new std::string(this->html);
+            result.fetch_code = FetchCode::NO_FETCH_ERROR;
+            result.code = CURLE_OK;
+            result.status = 200;
+            result.attempts = 1;
+            result.wire_bytes = this->html.size();
+            result.decoded_bytes = this->html.size();
+            result.from_cache = false;
+            return result;
+        }
+
+    private:
+
+        const std::string& html;
+};
+
+/**
+ * @brief Generates a deterministic page of roughly `bytes` bytes.
+ *
+ * The body is a sequence of articles of nested block elements, each holding paragraphs of
+ * text with attributes, entities, inline links, comments and void elements, the mix found on
+ * typical content pages.
+ */
+static std::string generate_page(size_t bytes)
+{
+    static const char* WORDS[] = { "crawler", "parse", "token", "markup", "element", "throughput", "anchor", "stream" };
+
+    std::string html = "<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n<meta charset=\"utf-8\">\n<title>Parse benchmark</title>\n"
+        "<style>body { margin: 0 } p > a { color: #333 }</style>\n</head>\n<body>\n";
+    html.reserve(bytes + 4096);
+
+    unsigned int seed = 12345;
+    int article = 0;
+
+    while (html.size() < bytes)
+    {
+        html += "<div class=\"article\" id=\"a" + std::to_string(article) + "\">\n<h2>Article " + std::to_string(article) + "</h2>\n";
+        html += "<!-- article " + std::to_string(article) + " -->\n<section>\n";
+
+        for (int paragraph = 0; paragraph < 6; paragraph++)
+        {
+            html += "<p class=\"text\">";
+            for (int word = 0; word < 40; word++)
+            {
+                seed = seed * 1103515245 + 12345;
+                unsigned int pick = (seed >> 16) % 64;
+
+                if (pick == 0)
+                {
+                    html += "<a href=\"https://example.com/page?id=" + std::to_string(seed % 1000) + "&amp;ref=bench\">link</a> ";
+                }
+                else if (pick == 1)
+                {
+                    html += "<span class=\"em\">" + std::string(WORDS[seed % 8]) + "</span> ";
+                }
+                else if (pick == 2)
+                {
+                    html += "&quot;quoted&quot; ";
+                }
+                else if (pick == 3)
+                {
+                    html += "<br>";
+                }
+                else
+                {
+                    html += WORDS[pick % 8];
+                    html += ' ';
+                }
+            }
+            html += "</p>\n";
+        }
+
+        html += "<img src=\"/img/" + std::to_string(article) + ".png\" alt=\"figure\">\n</section>\n</div>\n";
+        article++;
+    }
+
+    html += "<script>var done = 1 < 2;</script>\n</body>\n</html>\n";
+    return html;
+}
+
+/**
+ * @brief Generates a page of `elements` elements in the given shape, for the scaling run.
+ *
+ * "list" is one flat <ul> of <li> items, so every element is a sibling of the previous one;
+ * "table" is rows of three cells; "nested" is blocks of <div><p><span> three levels deep.
+ */
+static std::string generate_shaped_page(const std::string& shape, size_t elements)
+{
+    std::string html = "<!DOCTYPE html>\n<html>\n<head>\n<title>Scaling</title>\n</head>\n<body>\n";
+    html.reserve(elements * 32 + 256);
+
+    if (shape == "list")
+    {
+        html += "<ul>\n";
+        for (size_t i = 0; i < elements; i++)
+        {
+            html += "<li>item " + std::to_string(i) + "</li>\n";
+        }
+        html += "</ul>\n";
+    }
+    else if (shape == "table")
+    {
+        html += "<table>\n";
+        for (size_t i = 0; i < elements; i += 4)
+        {
+            html += "<tr><td>" + std::to_string(i) + "</td><td>cell</td><td>cell</td></tr>\n";
+        }
+        html += "</table>\n";
+    }
+    else
+    {
+        for (size_t i = 0; i < elements; i += 3)
+        {
+            html += "<div><p>text <span>" + std::to_string(i) + "</span></p></div>\n";
+        }
+    }
+
+    html += "</body>\n</html>\n";
+    return html;
+}
+
+/**
+ * @brief Scans tags the way parseTagTree used to, for comparison: find, find and substr per tag.
+ */
+static size_t scan_with_find(const std::string& html)
+{
+    size_t tags = 0;
+    size_t pos = 0;
+
+    while (pos < html.size())
+    {
+        pos = html.find('<', pos);
+        if (pos == std::string::npos)
+        {
+            break;
+        }
+
+        size_t start_open = pos;
+        pos = html.find('>', pos);
+        if (pos == std::string::npos)
+        {
+            break;
+        }
+
+        std::string tag = html.substr(start_open, pos - start_open + 1);
+        size_t next_space = html.find(' ', start_open);
+        size_t name_end = next_space == std::string::npos || next_space > pos ? pos : next_space;
+        std::string name = html.substr(start_open + 1, name_end - start_open - 1);
+
+        tags += tag.size() > name.size() ? 1 : 0;
+    }
+
+    return tags;
+}
+
+/**
+ * @brief Tokenizes the page with the HtmlTokenizer, returning the number of tags.
+ */
+static size_t scan_with_tokenizer(const std::string& html)
+{
+    size_t tags = 0;
+
+    HtmlTokenizer tokenizer(html);
+    HtmlToken token;
+    while (tokenizer.next(token))
+    {
+        tags += token.type == HtmlTokenType::OPEN_TOKEN || token.type == HtmlTokenType::CLOSE_TOKEN ||
+            token.type == HtmlTokenType::SELF_CLOSING_TOKEN ? 1 : 0;
+    }
+
+    return tags;
+}
+
+/**
+ * @brief Classifies every block of the page, returning the number of '<' found.
+ */
+static size_t classify_blocks(const std::string& html)
+{
+    size_t tags = 0;
+    StructuralBlock blocks[StructuralScanner::WINDOW_BLOCKS];
+    const size_t window = StructuralScanner::WINDOW_BLOCKS * StructuralScanner::BLOCK_SIZE;
+
+    for (size_t offset = 0; offset < html.size(); offset += window)
+    {
+        StructuralScanner::classify(html.data() + offset, html.size() - offset, blocks, StructuralScanner::WINDOW_BLOCKS);
+        for (const StructuralBlock& block : blocks)
+        {
+            for (uint64_t bits = block.bits[LESS_THAN]; bits != 0; bits &= bits - 1)
+            {
+                tags++;
+            }
+        }
+    }
+
+    return tags;
+}
+
+/**
+ * @brief Runs a scanner `iterations` times and returns the best throughput in GB/s.
+ */
+static double best_throughput(size_t (*scan)(const std::string&), const std::string& html, int iterations, size_t& tags)
+{
+    long long best_us = -1;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        long long start_us = now_us();
+        tags = scan(html);
+        long long elapsed_us = std::max(1LL, now_us() - start_us);
+        best_us = best_us == -1 ? elapsed_us : std::min(best_us, elapsed_us);
+    }
+
+    return html.size() / (best_us / 1000000.0) / 1e9;
+}
+
+/**
+ * @brief Scrapes the page through a WebPage and returns the time taken in milliseconds.
+ */
+static double scrape_ms(const std::string& html, int& code)
+{
+    PageTransport transport(html);
+
+    long long start_us = now_us();
+    WebPage page("http://bench.invalid/", &transport);
+    code = page.scrape();
+    return (now_us() - start_us) / 1000.0;
+}
+
+/**
+ * @brief Prints the command line options.
+ */
+static void usage()
+{
+    std::printf(
+        "Usage: ParseBenchmark [options] [FILE...]\n"
+        "  --size MB           Size of the generated page when no files are given (default 64)\n"
+        "  --iterations N      Passes over each page, the fastest is reported (default 5)\n"
+        "  --scrape-kb KB      Size of the generated page scraped through WebPage, 0 to skip (default 256)\n"
+        "  --scaling N         Scrape pages of 10^3 elements up to N in each shape, then exit (default 0, off)\n");
+}
+
+int main(int argc, char** argv)
+{
+    size_t size_mb = 64;
+    int iterations = 5;
+    size_t scrape_kb = 256;
+    size_t scaling = 0;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+
+        if (option.compare(0, 2, "--") != 0)
+        {
+            files.push_back(option);
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 1;
+        }
+
+        std::string value = argv[++i];
+
+        if (option == "--size")
+        {
+            size_mb = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (option == "--iterations")
+        {
+            iterations = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (option == "--scrape-kb")
+        {
+            scrape_kb = std::max(0, std::atoi(value.c_str()));
+        }
+        else if (option == "--scaling")
+        {
+            scaling = std::max(0, std::atoi(value.c_str()));
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if (scaling > 0)
+    {
+        // Building the tree should take time proportional to the number of elements, so the
+        // time per element stays flat as the pages grow
+        std::printf("%-8s %10s %10s %12s %14s\n", "shape", "elements", "MB", "scrape ms", "ns/element");
+        for (const char* shape : { "list", "table", "nested" })
+        {
+            for (size_t elements = 1000; elements <= scaling; elements *= 10)
+            {
+                std::string html = generate_shaped_page(shape, elements);
+                int code = 0;
+                double elapsed_ms = scrape_ms(html, code);
+
+                std::printf("%-8s %10zu %10.2f %12.1f %14.1f\n", shape, elements, html.size() / 1048576.0,
+                    elapsed_ms, elapsed_ms * 1e6 / elements);
+            }
+        }
+        return 0;
+    }
+
+    std::vector<std::pair<std::string, std::string>> pages;
+    for (const std::string& file : files)
+    {
+        std::ifstream in(file, std::ios::binary);
+        if (!in)
+        {
+            std::fprintf(stderr, "Cannot read %s\n", file.c_str());
+            return 1;
+        }
+        std::stringstream contents;
+        contents << in.rdbuf();
+        pages.emplace_back(file, contents.str());
+    }
+    if (pages.empty())
+    {
+        pages.emplace_back("generated", generate_page(size_mb << 20));
+    }
+
+    ScanKernel best_kernel = StructuralScanner::get_kernel();
+
+    for (const auto& page : pages)
+    {
+        size_t tags = 0;
+        double find_gbps = best_throughput(scan_with_find, page.second, iterations, tags);
+
+        std::printf("%s: %.2f MB\n", page.first.c_str(), page.second.size() / 1048576.0);
+        std::printf("  %-22s %14s %10s\n", "scanner", "GB/s", "tags");
+        std::printf("  %-22s %14.3f %10zu\n", "find/substr", find_gbps, tags);
+
+        for (int kernel = ScanKernel::SCALAR_KERNEL; kernel <= best_kernel; kernel++)
+        {
+            StructuralScanner::set_kernel(static_cast<ScanKernel>(kernel));
+            std::string name = StructuralScanner::kernel_name(static_cast<ScanKernel>(kernel));
+
+            size_t less_than = 0;
+            double classify_gbps = best_throughput(classify_blocks, page.second, iterations, less_than);
+            double tokenizer_gbps = best_throughput(scan_with_tokenizer, page.second, iterations, tags);
+
+            std::printf("  %-22s %14.3f %10s\n", (name + " blocks").c_str(), classify_gbps, "");
+            std::printf("  %-22s %14.3f %10zu\n", (name + " tokenizer").c_str(), tokenizer_gbps, tags);
+        }
+
+        StructuralScanner::set_kernel(best_kernel);
+    }
+
+    if (scrape_kb > 0)
+    {
+        std::string html = generate_page(scrape_kb << 10);
+        int code = 0;
+        double elapsed_ms = scrape_ms(html, code);
+
+        std::printf("\nscrape of a %zu KB page: %.1f ms, %.3f MB/s (code %d)\n",
+            html.size() >> 10, elapsed_ms, html.size() / 1e6 / (elapsed_ms / 1000.0), code);
+    }
+
+    return 0;
+}
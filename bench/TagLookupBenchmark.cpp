@@ -0,0 +1,217 @@
+#include <Tags.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ */
+static long long now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief The map stringToTagType used to look names up in, kept here for comparison.
+ */
+static const std::unordered_map<std::string, TagType> string_to_tag = {
+    {"!DOCTYPE", DOCTYPE}, {"html", HTML}, {"head", HEAD}, {"title", TITLE}, {"meta", META},
+    {"body", BODY}, {"p", P}, {"b", B}, {"i", I}, {"h1", H1}, {"h2", H2}, {"h3", H3},
+    {"h4", H4}, {"h5", H5}, {"h6", H6}, {"a", A}, {"img", IMG}, {"div", DIV}, {"span", SPAN},
+    {"ul", UL}, {"ol", OL}, {"li", LI}, {"table", TABLE}, {"tr", TR}, {"th", TH}, {"td", TD},
+    {"form", FORM}, {"label", LABEL}, {"input", INPUT__TEXT}, {"button", BUTTON},
+    {"select", SELECT}, {"option", OPTION}, {"textarea", TEXTAREA}, {"script", SCRIPT},
+    {"style", STYLE}, {"link", LINK}, {"br", BR}, {"hr", HR}, {"!--", COMMENT},
+    {"unknown", UNKNOWN}, {"cite", CITE}, {"font", FONT}
+};
+
+/**
+ * @brief The previous stringToTagType: a std::string per call, and an exception per unknown name.
+ */
+static TagType map_with_exceptions(std::string_view name)
+{
+    try
+    {
+        return string_to_tag.at(std::string(name));
+    }
+    catch (std::out_of_range&)
+    {
+        return TagType::UNKNOWN;
+    }
+}
+
+/**
+ * @brief The same map searched with find, to separate the cost of the exceptions from the hashing.
+ */
+static TagType map_with_find(std::string_view name)
+{
+    auto found = string_to_tag.find(std::string(name));
+    return found != string_to_tag.end() ? found->second : TagType::UNKNOWN;
+}
+
+/**
+ * @brief The perfect hash lookup.
+ */
+static TagType perfect_hash(std::string_view name)
+{
+    return stringToTagType(name);
+}
+
+/**
+ * @brief Builds a stream of tag names with the mix of a typical page.
+ *
+ * Most names are common known tags; about a quarter are tags the crawler does not know (nav,
+ * section, svg, ...), some are upper case, and a few are long custom element names.
+ */
+static std::vector<std::string> generate_names(size_t count, unsigned int seed)
+{
+    static const char* KNOWN[] = { "div", "a", "span", "p", "li", "img", "td", "tr", "br", "script",
+        "meta", "link", "ul", "h2", "input", "button", "option", "table", "b", "i", "style", "title" };
+    static const char* UNKNOWN_NAMES[] = { "nav", "section", "svg", "path", "article", "header", "footer",
+        "main", "figure", "picture", "source", "noscript", "iframe", "em", "strong", "small", "time" };
+    static const char* UPPER[] = { "DIV", "A", "TD", "TR", "Span", "P", "TABLE", "IMG", "BR" };
+    static const char* CUSTOM[] = { "my-custom-element", "ytd-rich-grid-renderer", "x-data-table" };
+
+    std::vector<std::string> names;
+    names.reserve(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        unsigned int pick = (seed >> 16) % 100;
+        unsigned int index = seed >> 8;
+
+        if (pick < 65)
+        {
+            names.push_back(KNOWN[index % (sizeof(KNOWN) / sizeof(KNOWN[0]))]);
+        }
+        else if (pick < 90)
+        {
+            names.push_back(UNKNOWN_NAMES[index % (sizeof(UNKNOWN_NAMES) / sizeof(UNKNOWN_NAMES[0]))]);
+        }
+        else if (pick < 97)
+        {
+            names.push_back(UPPER[index % (sizeof(UPPER) / sizeof(UPPER[0]))]);
+        }
+        else
+        {
+            names.push_back(CUSTOM[index % (sizeof(CUSTOM) / sizeof(CUSTOM[0]))]);
+        }
+    }
+
+    return names;
+}
+
+/**
+ * @brief Looks the names up `rounds` times per pass and returns the fastest pass in nanoseconds per lookup.
+ */
+static double best_ns(TagType (*lookup)(std::string_view), const std::vector<std::string_view>& names, int rounds, int iterations, long long& checksum)
+{
+    long long best = -1;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        long long sum = 0;
+        long long start = now_ns();
+        for (int round = 0; round < rounds; round++)
+        {
+            for (std::string_view name : names)
+            {
+                sum += lookup(name);
+            }
+        }
+        long long elapsed = now_ns() - start;
+
+        checksum = sum;
+        best = best == -1 ? elapsed : std::min(best, elapsed);
+    }
+
+    return static_cast<double>(best) / (static_cast<double>(names.size()) * rounds);
+}
+
+/**
+ * @brief Prints the command line options.
+ */
+static void usage()
+{
+    std::printf(
+        "Usage: TagLookupBenchmark [options]\n"
+        "  --names N           Distinct positions in the name stream, small enough to stay in cache (default 4096)\n"
+        "  --rounds N          Times the stream is looked up per pass (default 250)\n"
+        "  --iterations N      Passes per lookup, the fastest is reported (default 5)\n");
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = 4096;
+    int rounds = 250;
+    int iterations = 5;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 1;
+        }
+
+        std::string value = argv[++i];
+
+        if (option == "--names")
+        {
+            count = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (option == "--rounds")
+        {
+            rounds = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (option == "--iterations")
+        {
+            iterations = std::max(1, std::atoi(value.c_str()));
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    std::vector<std::string> storage = generate_names(count, 12345);
+    std::vector<std::string_view> names(storage.begin(), storage.end());
+
+    struct Candidate
+    {
+        const char* name;
+        TagType (*lookup)(std::string_view);
+    };
+
+    const Candidate candidates[] = {
+        { "map + exceptions", map_with_exceptions },
+        { "map + find", map_with_find },
+        { "perfect hash", perfect_hash },
+    };
+
+    std::printf("%zu names x %d rounds per pass, %d passes\n\n", names.size(), rounds, iterations);
+    std::printf("%-20s %12s %14s %12s\n", "lookup", "ns/lookup", "Mlookups/s", "checksum");
+
+    for (const Candidate& candidate : candidates)
+    {
+        long long checksum = 0;
+        double ns = best_ns(candidate.lookup, names, rounds, iterations, checksum);
+        std::printf("%-20s %12.2f %14.1f %12lld\n", candidate.name, ns, 1000.0 / ns, checksum);
+    }
+
+    std::printf("\nThe perfect hash also recognises upper-case names, which the map reports as unknown.\n");
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include <ConcurrencyLimiter.hpp>
+
+
+/**
+ * @brief Multiplies the limit by this on a dropped request.
+ */
+static const double DROP_BACKOFF = 0.5;
+
+/**
+ * @brief Multiplies the limit by this when the round trip has inflated.
+ */
+static const double LATENCY_BACKOFF = 0.9;
+
+/**
+ * @brief How many times the baseline a round trip may take before it counts as congestion.
+ */
+static const double LATENCY_TOLERANCE = 2.0;
+
+
+/**
+ * @brief Constructs a new ConcurrencyLimiter object.
+ *
+ * @param initial_limit The limit to start from.
+ * @param min_limit The limit is never lowered below this, at least 1.
+ * @param max_limit The limit is never raised above this.
+ */
+ConcurrencyLimiter::ConcurrencyLimiter(int initial_limit, int min_limit, int max_limit)
+{
+    this->configure(initial_limit, min_limit, max_limit);
+}
+
+/**
+ * @brief Destructor for the ConcurrencyLimiter class.
+ */
+ConcurrencyLimiter::~ConcurrencyLimiter()
+{
+}
+
+/**
+ * @brief Resets the limit and its bounds, keeping the measured round trips.
+ *
+ * @param initial_limit The limit to start from, clamped to the bounds.
+ * @param min_limit The limit is never lowered below this, at least 1.
+ * @param max_limit The limit is never raised above this.
+ */
+void ConcurrencyLimiter::configure(int initial_limit, int min_limit, int max_limit)
+{
+    this->min_limit = min_limit < 1 ? 1 : min_limit;
+    this->max_limit = max_limit < this->min_limit ? this->min_limit : max_limit;
+
+    this->current = initial_limit;
+    if (this->current < this->min_limit)
+    {
+        this->current = this->min_limit;
+    }
+    if (this->current > this->max_limit)
+    {
+        this->current = this->max_limit;
+    }
+}
+
+/**
+ * @brief Adjusts the limit with the outcome of one completed request.
+ *
+ * @param rtt_ms The time the request took to its first response byte, or in total if none arrived.
+ * @param dropped Whether the request failed in a way that suggests overload.
+ * @param in_flight The number of requests in flight when it completed, including itself.
+ * @param now_ms The current monotonic time in milliseconds.
+ * @param judge_latency Whether an inflated round trip counts as congestion, or only paces decreases.
+ */
+void ConcurrencyLimiter::on_sample(long long rtt_ms, bool dropped, int in_flight, long long now_ms, bool judge_latency)
+{
+    if (rtt_ms >= 0)
+    {
+        this->smoothed_rtt_ms = this->smoothed_rtt_ms < 0 ? rtt_ms : this->smoothed_rtt_ms * 0.9 + rtt_ms * 0.1;
+    }
+
+    if (dropped)
+    {
+        this->decrease(DROP_BACKOFF, now_ms);
+        return;
+    }
+
+    if (rtt_ms >= 0 && judge_latency && this->inflated(rtt_ms))
+    {
+        this->decrease(LATENCY_BACKOFF, now_ms);
+        return;
+    }
+
+    // Only grow a limit that is being used, or an idle client would raise it without bound
+    if (in_flight * 2 >= this->current)
+    {
+        this->current += 1.0 / this->current;
+        if (this->current > this->max_limit)
+        {
+            this->current = this->max_limit;
+        }
+    }
+}
+
+/**
+ * @brief Adds a round trip to the baseline and checks whether it is inflated against it.
+ */
+bool ConcurrencyLimiter::inflated(long long rtt_ms)
+{
+    // Track the shortest round trip per window, so the baseline follows the path
+    if (this->window_min_ms == -1 || rtt_ms < this->window_min_ms)
+    {
+        this->window_min_ms = rtt_ms;
+    }
+    if (this->baseline_ms == -1 || rtt_ms < this->baseline_ms)
+    {
+        this->baseline_ms = rtt_ms;
+    }
+    if (++this->window_samples >= WINDOW_SAMPLES)
+    {
+        this->baseline_ms = this->window_min_ms;
+        this->window_min_ms = -1;
+        this->window_samples = 0;
+    }
+
+    // A floor of a millisecond keeps loopback and cached responses from looking congested
+    long long baseline_ms = this->baseline_ms < 1 ? 1 : this->baseline_ms;
+    return rtt_ms > baseline_ms * LATENCY_TOLERANCE;
+}
+
+/**
+ * @brief Lowers the limit, unless it was already lowered within the last round trip.
+ */
+void ConcurrencyLimiter::decrease(double factor, long long now_ms)
+{
+    long long pacing_ms = this->smoothed_rtt_ms < 0 ? 0 : static_cast<long long>(this->smoothed_rtt_ms);
+    if (this->last_decrease_ms != -1 && now_ms - this->last_decrease_ms < pacing_ms)
+    {
+        return;
+    }
+
+    this->last_decrease_ms = now_ms;
+    this->current *= factor;
+    if (this->current < this->min_limit)
+    {
+        this->current = this->min_limit;
+    }
+}
+
+/**
+ * @brief Returns the current limit.
+ */
+int ConcurrencyLimiter::limit() const
+{
+    return static_cast<int>(this->current);
+}
+
+/**
+ * @brief Returns the baseline round trip in milliseconds, or -1 before any sample.
+ */
+long long ConcurrencyLimiter::baseline_rtt_ms() const
+{
+    return this->baseline_ms;
+}
@@ -1,20 +1,180 @@
 #include <CurlManager.hpp>
 #include <Logger.hpp>
+#include <Utilities.hpp>
 #include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+
+
+/**
+ * @brief Hands out the ids that key each CurlManager's per-thread handles, never reused.
+ */
+static std::atomic<unsigned long long> next_manager_id(1);
+
+/**
+ * @brief Guards `thread_handles_by_manager`.
+ */
+static std::mutex& thread_handles_lock()
+{
+    static std::mutex lock;
+    return lock;
+}
+
+/**
+ * @brief The per-thread easy handles created for each live CurlManager, by manager id.
+ *
+ * A manager cleans up its handles when it is destroyed, since they are attached to its share,
+ * and a thread that exits first cleans up its own. Both are local statics so that they exist
+ * before the global curl_manager is constructed, whatever the order of initialisation.
+ */
+static std::unordered_map<unsigned long long, std::unordered_set<CURL*>>& thread_handles_by_manager()
+{
+    static std::unordered_map<unsigned long long, std::unordered_set<CURL*>> handles;
+    return handles;
+}
+
+/**
+ * @struct ThreadHandles
+ * @brief The easy handles used by blocking `get` calls on one thread, one per CurlManager.
+ *
+ * Every thread gets its own handle, so worker threads can fetch in parallel without any
+ * locking, and each handle keeps its connections alive between requests on that thread.
+ * Handles are kept per manager, as each is bound to its manager's share.
+ */
+struct ThreadHandles
+{
+    std::unordered_map<unsigned long long, CURL*> easy;    /**< The handle of each manager used on this thread, by manager id */
+
+    ~ThreadHandles()
+    {
+        std::lock_guard<std::mutex> guard(thread_handles_lock());
+
+        for (auto& handle : this->easy)
+        {
+            // A manager destroyed before the thread exits has already cleaned up its handles
+            auto manager = thread_handles_by_manager().find(handle.first);
+            if (manager != thread_handles_by_manager().end())
+            {
+                manager->second.erase(handle.second);
+                curl_easy_cleanup(handle.second);
+            }
+        }
+    }
+};
+
+static thread_local ThreadHandles thread_handles;
+
+/**
+ * @brief Classifies a finished transfer by whether trying it again could succeed.
+ *
+ * @param code The libcurl result of the transfer.
+ * @param status The HTTP status code of the response, or 0 if none was received.
+ * @return FetchCode The classification of the transfer.
+ */
+static FetchCode classify_transfer(CURLcode code, long status)
+{
+    switch (code)
+    {
+        case CURLE_OK:
+        {
+            break;
+        }
+
+        case CURLE_COULDNT_RESOLVE_PROXY:
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+        {
+            return FetchCode::TRANSIENT_FETCH_ERROR;
+        }
+
+        default:
+        {
+            return FetchCode::PERMANENT_FETCH_ERROR;
+        }
+    }
+
+    switch (status)
+    {
+        case 408:
+        case 425:
+        case 429:
+        case 500:
+        case 502:
+        case 503:
+        case 504:
+        {
+            return FetchCode::TRANSIENT_FETCH_ERROR;
+        }
+
+        default:
+        {
+            return status >= 400 ? FetchCode::PERMANENT_FETCH_ERROR : FetchCode::NO_FETCH_ERROR;
+        }
+    }
+}
+
+/**
+ * @brief The largest Content-Length trusted for reserving a body buffer up front.
+ */
+static const curl_off_t MAX_RESERVE_BYTES = 64 * 1024 * 1024;
+
+/**
+ * @brief How many times larger than its Content-Length a compressed body is assumed to decode to.
+ *
+ * Gzipped and brotli-compressed HTML usually shrinks to between a quarter and a tenth of its
+ * size, so this stays at or below the decoded size of most pages.
+ */
+static const curl_off_t ENCODED_RESERVE_RATIO = 4;
 
 
 /**
  * @brief Constructs a new CurlManager object.
  * 
  * This constructor initializes a libcurl session by calling `curl_global_init` 
- * with `CURL_GLOBAL_DEFAULT` and then initializes an easy curl handle using 
- * `curl_easy_init`. It also logs the initialization process.
+ * with `CURL_GLOBAL_DEFAULT` and then initializes the multi handle used for
+ * concurrent transfers. Easy handles for blocking requests are created lazily,
+ * one per calling thread. All handles share a DNS cache and TLS session cache through
+ * a share object. Connections are not shared, as libcurl does not support sharing them
+ * between threads: each blocking handle keeps its own, and the multi handle pools those of
+ * the concurrent transfers. It also logs the initialization process.
  */
 CurlManager::CurlManager() {
     // Initialize a curl session
     LOG("Initializing libcurl");
     curl_global_init(CURL_GLOBAL_DEFAULT);
-    this->curl = curl_easy_init();
+    this->multi = curl_multi_init();
+
+    this->id = next_manager_id++;
+    {
+        std::lock_guard<std::mutex> guard(thread_handles_lock());
+        thread_handles_by_manager()[this->id];
+    }
+
+    this->share = curl_share_init();
+    curl_share_setopt(this->share, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(this->share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(this->share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(this->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(this->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
 }
 
 /**
@@ -27,7 +187,57 @@ CurlManager::CurlManager() {
 CurlManager::~CurlManager() {
     // Clean up the curl session
     LOG("Cleaning up libcurl");
-    curl_easy_cleanup(this->curl);
+
+    for (Transfer* transfer : this->pending.drain())
+    {
+        delete transfer;
+    }
+
+    for (auto& retry : this->retries)
+    {
+        delete retry.second;
+    }
+
+    // Transfers still on the multi handle hold the share, so they go before either is cleaned up
+    for (Transfer* transfer : this->active)
+    {
+        curl_multi_remove_handle(this->multi, transfer->easy);
+        curl_easy_cleanup(transfer->easy);
+        curl_slist_free_all(transfer->request_headers);
+        delete transfer->html_content;
+        delete transfer;
+    }
+    this->active.clear();
+
+    for (CURL* easy : this->free_handles)
+    {
+        curl_easy_cleanup(easy);
+    }
+
+    curl_multi_cleanup(this->multi);
+
+    // The per-thread handles of every thread that used this manager are attached to the share too
+    {
+        std::lock_guard<std::mutex> guard(thread_handles_lock());
+
+        auto handles = thread_handles_by_manager().find(this->id);
+        for (CURL* easy : handles->second)
+        {
+            curl_easy_cleanup(easy);
+        }
+        thread_handles_by_manager().erase(handles);
+    }
+
+    // Only safe once every handle using the share has been cleaned up
+    curl_share_cleanup(this->share);
+
+#ifdef __linux__
+    if (this->epoll_fd != -1)
+    {
+        close(this->epoll_fd);
+    }
+#endif
+
     // Clean up global libcurl state
     curl_global_cleanup();
 }
@@ -42,40 +252,1505 @@ CurlManager::~CurlManager() {
  * If the request is successful, it returns a pointer to a new std::string containing
  * the HTML content. If the request fails, it logs an error message and returns nullptr.
  *
+ * The request runs on the calling thread's own easy handle, so several threads may call
+ * `get` at the same time without sharing any state.
+ *
  * @param url The URL to send the GET request to.
  * @return std::string* A pointer to a std::string containing the HTML content if the request is successful, or nullptr if the request fails.
  */
 std::string* CurlManager::get(const char* url) {
+    return this->fetch(url).html_content;
+}
+
+/**
+ * @brief Sends a GET request and returns the full result of the transfer.
+ *
+ * This behaves like `get`, but also reports the libcurl result, the HTTP status, how the
+ * outcome was classified and the number of body bytes received on the wire and after
+ * decompression. Transient failures are retried with jittered exponential backoff,
+ * sleeping on the calling thread between attempts.
+ *
+ * @param url The URL to send the GET request to.
+ * @return FetchResult The result of the transfer. The caller owns its HTML content.
+ */
+FetchResult CurlManager::fetch(const char* url) {
     LOG("Sending GET request to: ", url);
 
-    // Set the URL to request
-    curl_easy_setopt(this->curl, CURLOPT_URL, url);
+    Transfer transfer;
+    transfer.url = url;
+    transfer.host = url_host(transfer.url);
+
+    return this->fetch_blocking(transfer);
+}
+
+/**
+ * @brief Sends a GET request that follows redirects and ignores the content limits.
+ *
+ * Meant for files the crawler needs whatever the server labels them as, such as robots.txt,
+ * which RFC 9309 requires to be fetched through at least five redirects. It otherwise behaves
+ * like `fetch`, retries included.
+ *
+ * @param url The URL to send the GET request to.
+ * @param max_redirects The number of redirects to follow before failing with CURLE_TOO_MANY_REDIRECTS.
+ * @return FetchResult The result of the transfer. The caller owns its HTML content.
+ */
+FetchResult CurlManager::fetch_unfiltered(const char* url, long max_redirects)
+{
+    LOG("Sending unfiltered GET request to: ", url);
+
+    Transfer transfer;
+    transfer.url = url;
+    transfer.host = url_host(transfer.url);
+    transfer.unfiltered = true;
+    transfer.max_redirects = max_redirects;
+
+    return this->fetch_blocking(transfer);
+}
 
-    std::string html_content;
+/**
+ * @brief Performs a transfer on the calling thread until it succeeds or is not worth retrying.
+ *
+ * @param transfer The transfer to perform, with its URL and options set.
+ * @return FetchResult The result of the last attempt. The caller owns its HTML content.
+ */
+FetchResult CurlManager::fetch_blocking(Transfer& transfer)
+{
+    while (true)
+    {
+        // The body is received straight into the string handed back to the caller
+        transfer.html_content = new std::string();
 
-    // Set the callback function to handle the response data
-    curl_easy_setopt(this->curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(this->curl, CURLOPT_WRITEDATA, &html_content);
+        // Perform the request
+        CURLcode res = this->perform(transfer);
+        FetchResult result = this->complete_transfer(transfer, res);
 
-    // Perform the request
-    CURLcode res = curl_easy_perform(this->curl);
+        if (!this->should_retry(transfer, result))
+        {
+            return result;
+        }
 
-    // Check if the request was successful
-    if (res != CURLE_OK) {
-        LOG("Failed to get HTML from: ", url, " - ", curl_easy_strerror(res));
-        return nullptr;
+        long long delay_ms = this->retry_delay_ms(transfer, result);
+        LOG("Retrying GET request to: ", transfer.url, " in ", delay_ms, "ms");
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
     }
+}
+
+/**
+ * @brief Sends a GET request and streams the response body to a callback as it arrives.
+ *
+ * Unlike `get`, the body is never buffered: each chunk is passed to `on_chunk` straight
+ * from libcurl's write path, so the consumer can start processing it while the rest of
+ * the page is still in transit, and peak memory does not grow with the size of the page.
+ * A transient failure is only retried if no part of the body had been delivered yet.
+ *
+ * @param url The URL to send the GET request to.
+ * @param on_chunk The callback receiving each chunk of the body. Returning false aborts the transfer.
+ * @return CURLcode CURLE_OK if the whole body was delivered, otherwise the libcurl error.
+ */
+CURLcode CurlManager::get_stream(const char* url, ChunkCallback on_chunk)
+{
+    LOG("Streaming GET request to: ", url);
+
+    Transfer transfer;
+    transfer.url = url;
+    transfer.host = url_host(transfer.url);
+    transfer.html_content = nullptr;
+    transfer.on_chunk = on_chunk;
+
+    while (true)
+    {
+        CURLcode res = this->perform(transfer);
+        FetchResult result = this->complete_transfer(transfer, res);
 
-    // Create a new WebPage object with the URL and HTML content
-    return new std::string(html_content);
+        if (!this->should_retry(transfer, result))
+        {
+            return res;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(this->retry_delay_ms(transfer, result)));
+    }
 }
 
-size_t CurlManager::write_callback(void* ptr, size_t size, size_t nmemb, void* userdata) {
-    size_t realsize = size * nmemb;
-    std::string* html_content = static_cast<std::string*>(userdata);
+/**
+ * @brief Performs a transfer on the calling thread's own easy handle.
+ *
+ * The handle is created on the thread's first request through this manager and reset before
+ * each later one, which keeps its open connections for reuse.
+ *
+ * @param transfer The transfer to perform, receiving the body through its sink.
+ * @return CURLcode The libcurl result of the transfer.
+ */
+CURLcode CurlManager::perform(Transfer& transfer)
+{
+    CURL*& easy = thread_handles.easy[this->id];
+
+    if (easy == nullptr)
+    {
+        easy = curl_easy_init();
+
+        std::lock_guard<std::mutex> guard(thread_handles_lock());
+        thread_handles_by_manager()[this->id].insert(easy);
+    }
+    else
+    {
+        curl_easy_reset(easy);
+    }
+
+    transfer.easy = easy;
+    this->attach_transfer(transfer);
+
+    return curl_easy_perform(transfer.easy);
+}
+
+/**
+ * @brief Queues a GET request to be performed concurrently on the multi handle.
+ *
+ * The request is not started until `poll` is called. At most `max_in_flight` transfers, or
+ * the adaptive limit if enabled, run at once; any others wait in the queue and are started as earlier ones complete,
+ * subject to the per-host limits set with `set_host_limits`.
+ * Once the transfer has finished, `on_complete` is invoked from within `poll` with the
+ * result, and takes ownership of the returned HTML content.
+ *
+ * @param url The URL to send the GET request to.
+ * @param on_complete The callback invoked with the result of the transfer.
+ */
+void CurlManager::submit(const char* url, FetchCallback on_complete)
+{
+    LOG("Queueing GET request to: ", url);
+
+    Transfer* transfer = new Transfer();
+    transfer->easy = nullptr;
+    transfer->url = url;
+    transfer->host = url_host(transfer->url);
+    transfer->html_content = nullptr;
+    transfer->on_complete = on_complete;
+
+    this->pending.push(transfer->host, transfer);
+}
+
+/**
+ * @brief Queues a GET request whose body is streamed to a callback as it arrives.
+ *
+ * This behaves like `submit`, except that the body is not buffered: `on_chunk` is invoked
+ * from within `poll` with each chunk as soon as libcurl receives it, and the result passed
+ * to `on_complete` carries a nullptr body.
+ *
+ * @param url The URL to send the GET request to.
+ * @param on_chunk The callback receiving each chunk of the body. Returning false aborts the transfer.
+ * @param on_complete The callback invoked with the result of the transfer.
+ */
+void CurlManager::submit_stream(const char* url, ChunkCallback on_chunk, FetchCallback on_complete)
+{
+    LOG("Queueing streamed GET request to: ", url);
+
+    Transfer* transfer = new Transfer();
+    transfer->easy = nullptr;
+    transfer->url = url;
+    transfer->host = url_host(transfer->url);
+    transfer->html_content = nullptr;
+    transfer->on_chunk = on_chunk;
+    transfer->on_complete = on_complete;
+
+    this->pending.push(transfer->host, transfer);
+}
+
+/**
+ * @brief Drives all queued and in-flight transfers.
+ *
+ * This function starts queued transfers up to the in-flight limit, lets libcurl make progress
+ * on every active transfer, waiting up to `timeout_ms` milliseconds for socket activity, and
+ * delivers the results of any transfers that have finished to their callbacks.
+ *
+ * @param timeout_ms The maximum time to wait for activity, in milliseconds.
+ * @return int The number of transfers still queued or in flight.
+ */
+int CurlManager::poll(int timeout_ms)
+{
+    this->start_pending();
+
+    if (this->backend == FetchBackend::SOCKET_BACKEND)
+    {
+        this->wait_sockets(this->wait_timeout_ms(timeout_ms));
+        this->collect_completed();
+        this->start_pending();
+        this->start_hedges();
+
+        return this->in_flight + static_cast<int>(this->pending.size() + this->retries.size());
+    }
+
+    int running = 0;
+    CURLMcode mc = curl_multi_perform(this->multi, &running);
+
+    // Hand back what has finished and fill the freed slots before sleeping, as nothing wakes
+    // curl_multi_poll for a transfer that is only waiting for a slot
+    this->collect_completed();
+    this->start_pending();
+    this->start_hedges();
+
+    // Whatever is still queued now is throttled, and the timeout is capped to when it may start
+    timeout_ms = this->wait_timeout_ms(timeout_ms);
+    if (mc == CURLM_OK && !this->idle() && timeout_ms > 0)
+    {
+        // Unlike curl_multi_wait, this also sleeps while only throttled transfers are queued
+        mc = curl_multi_poll(this->multi, nullptr, 0, timeout_ms, nullptr);
+        if (mc == CURLM_OK)
+        {
+            mc = curl_multi_perform(this->multi, &running);
+        }
+    }
+
+    if (mc != CURLM_OK)
+    {
+        LOG("Multi handle failed: ", curl_multi_strerror(mc));
+    }
+
+    this->collect_completed();
+    this->start_pending();
+    this->start_hedges();
+
+    return this->in_flight + static_cast<int>(this->pending.size() + this->retries.size());
+}
+
+/**
+ * @brief Shortens a wait so that `poll` wakes up in time for the next scheduled event.
+ *
+ * Those are a host whose rate limit is about to let a queued transfer start, a slow transfer
+ * becoming due for a hedge, and a retry whose backoff delay is about to pass.
+ *
+ * @param timeout_ms The longest the caller is willing to wait, in milliseconds.
+ * @return int The time to wait, in milliseconds, at most `timeout_ms`.
+ */
+int CurlManager::wait_timeout_ms(int timeout_ms)
+{
+    // Wake up in time to start transfers for hosts whose rate limit is about to allow them
+    long long wake_ms = this->pending.next_wake_ms(now_ms());
+    if (this->in_flight < this->get_concurrency_limit() && wake_ms >= 0 && wake_ms < timeout_ms)
+    {
+        timeout_ms = static_cast<int>(wake_ms);
+    }
+
+    // ... for slow transfers about to become due for a hedge
+    if (this->hedging && this->hedge_delay_ms >= 0 && !this->hedge_candidates.empty())
+    {
+        long long hedge_ms = this->hedge_candidates.front()->started_ms + this->hedge_delay_ms - now_ms();
+        if (hedge_ms < timeout_ms)
+        {
+            timeout_ms = hedge_ms < 0 ? 0 : static_cast<int>(hedge_ms);
+        }
+    }
+
+    // ... and for retries whose backoff delay is about to pass
+    if (!this->retries.empty())
+    {
+        long long retry_ms = this->retries.begin()->first - now_ms();
+        if (retry_ms < timeout_ms)
+        {
+            timeout_ms = retry_ms < 0 ? 0 : static_cast<int>(retry_ms);
+        }
+    }
+
+    return timeout_ms;
+}
+
+/**
+ * @brief Checks whether the manager has no queued or in-flight transfers.
+ *
+ * @return true if there is nothing left to drive, false otherwise.
+ */
+bool CurlManager::idle()
+{
+    return this->in_flight == 0 && this->pending.size() == 0 && this->retries.empty();
+}
+
+/**
+ * @brief Fetches several URLs concurrently, blocking until all of them have finished.
+ *
+ * Each result is delivered to `on_complete` as soon as its transfer finishes, so results
+ * arrive in completion order rather than in the order of `urls`.
+ *
+ * @param urls The URLs to fetch.
+ * @param on_complete The callback invoked with the result of each transfer.
+ */
+void CurlManager::get_many(const std::vector<std::string>& urls, FetchCallback on_complete)
+{
+    for (const std::string& url : urls)
+    {
+        this->submit(url.c_str(), on_complete);
+    }
+
+    while (!this->idle())
+    {
+        this->poll(1000);
+    }
+}
+
+/**
+ * @brief Sets the maximum number of transfers the multi handle runs at once.
+ *
+ * @param max_in_flight The maximum number of concurrent transfers, at least 1.
+ */
+void CurlManager::set_max_in_flight(int max_in_flight)
+{
+    this->max_in_flight = max_in_flight < 1 ? 1 : max_in_flight;
+}
+
+/**
+ * @brief Enables or disables adaptive concurrency limits on the multi handle.
+ *
+ * When enabled, the number of transfers in flight overall and to each host is tuned by
+ * ConcurrencyLimiter instances (AIMD) from the outcome of every completed transfer. They
+ * replace `max_in_flight` and the connection limit of `set_host_limits`. A host's limit grows
+ * while its time to first byte stays near its best and backs off when it inflates or the
+ * host returns transient failures. The overall limit backs off only on transient failures,
+ * such as timeouts when egress is saturated, since latency differs too much between hosts.
+ *
+ * The overall limit starts at `max_in_flight` and each host's at 4, growing from there.
+ * Hosts keep their limiter for the lifetime of the manager.
+ *
+ * @param enabled Whether to adapt the limits.
+ * @param max_limit The most transfers ever allowed in flight overall.
+ * @param max_host_limit The most transfers ever allowed in flight to one host.
+ */
+void CurlManager::set_adaptive_concurrency(bool enabled, int max_limit, int max_host_limit)
+{
+    this->adaptive = enabled;
+    this->max_host_limit = max_host_limit < 1 ? 1 : max_host_limit;
+    this->global_limiter.configure(this->max_in_flight, 1, max_limit);
+
+    for (auto& entry : this->host_limiters)
+    {
+        entry.second.configure(entry.second.limit(), 1, this->max_host_limit);
+        this->pending.set_host_connections(entry.first, enabled ? entry.second.limit() : -1);
+    }
+}
+
+/**
+ * @brief Returns the number of transfers currently allowed in flight overall.
+ */
+int CurlManager::get_concurrency_limit()
+{
+    return this->adaptive ? this->global_limiter.limit() : this->max_in_flight;
+}
+
+/**
+ * @brief Returns the adaptive limit of transfers in flight to a host, or 0 if it has none yet.
+ */
+int CurlManager::get_host_concurrency_limit(const std::string& host)
+{
+    auto found = this->host_limiters.find(host);
+    return found != this->host_limiters.end() ? found->second.limit() : 0;
+}
+
+/**
+ * @brief Sets the politeness limits applied to every host.
+ *
+ * Queued transfers to a host that is over its request rate or connection limit stay parked
+ * while transfers to other hosts keep starting, so the total number in flight stays high
+ * while each host sees a bounded load.
+ *
+ * @param rate The sustained requests per second allowed to each host, or 0 for no limit.
+ * @param burst The number of requests a host may receive at once after being idle.
+ * @param max_connections The number of concurrent transfers allowed to each host, or 0 for no limit.
+ */
+void CurlManager::set_host_limits(double rate, double burst, int max_connections)
+{
+    this->pending.set_default_limits(rate, burst, max_connections);
+}
+
+/**
+ * @brief Overrides the request rate of a single host.
+ *
+ * @param host The host to limit, as returned by `url_host`.
+ * @param rate The sustained requests per second allowed to the host, or 0 for no limit.
+ * @param burst The number of requests the host may receive at once after being idle.
+ */
+void CurlManager::set_host_rate(const std::string& host, double rate, double burst)
+{
+    this->pending.set_host_rate(host, rate, burst);
+}
+
+/**
+ * @brief Drops the request rate set for a single host, which goes back to the default limits.
+ *
+ * @param host The host whose rate to reset, as returned by `url_host`.
+ */
+void CurlManager::reset_host_rate(const std::string& host)
+{
+    this->pending.reset_host_rate(host);
+}
+
+/**
+ * @brief Selects how the multi handle waits for socket activity.
+ *
+ * The socket backend registers every transfer socket with epoll through libcurl's socket and
+ * timer callbacks, so each call to `poll` only touches the sockets that are actually ready,
+ * where the poll backend hands every socket to curl_multi_poll on each iteration. Against the
+ * loopback FixtureServer this roughly halves the CPU spent per transfer with 100 to 1000 slow
+ * transfers in flight. Once the server itself saturates, neither backend is consistently
+ * cheaper. The backend can only be changed while the manager is idle.
+ *
+ * @param backend The backend to use for subsequent transfers.
+ * @return true if the backend was selected, false if it is unavailable on this platform
+ *         or transfers are still running.
+ */
+bool CurlManager::set_backend(FetchBackend backend)
+{
+    if (!this->idle())
+    {
+        LOG("Cannot change the fetch backend while transfers are running");
+        return false;
+    }
+
+    if (backend == FetchBackend::POLL_BACKEND)
+    {
+        curl_multi_setopt(this->multi, CURLMOPT_SOCKETFUNCTION, nullptr);
+        curl_multi_setopt(this->multi, CURLMOPT_TIMERFUNCTION, nullptr);
+        this->backend = backend;
+        return true;
+    }
+
+#ifdef __linux__
+    if (this->epoll_fd == -1)
+    {
+        this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (this->epoll_fd == -1)
+        {
+            LOG("Failed to create epoll instance");
+            return false;
+        }
+    }
+
+    curl_multi_setopt(this->multi, CURLMOPT_SOCKETFUNCTION, socket_callback);
+    curl_multi_setopt(this->multi, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(this->multi, CURLMOPT_TIMERFUNCTION, timer_callback);
+    curl_multi_setopt(this->multi, CURLMOPT_TIMERDATA, this);
+    this->backend = backend;
+    return true;
+#else
+    LOG("Socket backend is not available on this platform");
+    return false;
+#endif
+}
+
+/**
+ * @brief Attaches a persistent disk cache used to revalidate responses.
+ *
+ * Buffered requests to URLs held in the cache are sent conditionally with the cached
+ * validators, and a 304 response is answered with the cached body instead of refetching
+ * it. The cache must outlive any transfer that uses it.
+ *
+ * @param cache The cache to use, or nullptr to disable caching.
+ */
+void CurlManager::set_http_cache(HttpCache* cache)
+{
+    this->http_cache = cache;
+}
+
+/**
+ * @brief Enables or disables compressed transfers.
+ *
+ * When enabled, which is the default, requests advertise gzip and deflate through
+ * `Accept-Encoding` and libcurl inflates the response with zlib as each chunk arrives, so
+ * bodies, streamed chunks and byte counts past the write callback are always decoded HTML.
+ * The bytes actually received on the wire are reported separately in `FetchResult`.
+ *
+ * @param enabled Whether to negotiate compressed transfers.
+ */
+void CurlManager::set_compression(bool enabled)
+{
+    this->compression = enabled;
+}
+
+/**
+ * @brief Sets the timeouts applied to every transfer.
+ *
+ * A transfer fails with a transient error once it has taken longer than `connect_ms` to
+ * connect, has stayed below `low_speed_bytes` per second for `low_speed_seconds`, or has run
+ * for longer than `total_ms` in total. A value of 0 disables the respective timeout.
+ *
+ * @param connect_ms The maximum time to establish a connection, in milliseconds.
+ * @param low_speed_bytes The transfer speed in bytes per second below which a transfer is stalled.
+ * @param low_speed_seconds How long a transfer may stay stalled before it is aborted, in seconds.
+ * @param total_ms The maximum duration of a whole transfer, in milliseconds.
+ */
+void CurlManager::set_timeouts(long connect_ms, long low_speed_bytes, long low_speed_seconds, long total_ms)
+{
+    this->connect_timeout_ms = connect_ms;
+    this->low_speed_bytes = low_speed_bytes;
+    this->low_speed_seconds = low_speed_seconds;
+    this->total_timeout_ms = total_ms;
+}
+
+/**
+ * @brief Sets how transient failures are retried.
+ *
+ * Each retry waits a random delay between half and all of `base_delay_ms` doubled for every
+ * earlier attempt, capped at `max_delay_ms`. Concurrent transfers wait in a retry queue
+ * without occupying a slot; blocking requests sleep on the calling thread.
+ *
+ * @param max_attempts The total number of attempts per request, 1 to disable retries.
+ * @param base_delay_ms The delay ceiling before the first retry, in milliseconds.
+ * @param max_delay_ms The largest delay between attempts, in milliseconds.
+ */
+void CurlManager::set_retry_policy(int max_attempts, long base_delay_ms, long max_delay_ms)
+{
+    this->max_attempts = max_attempts < 1 ? 1 : max_attempts;
+    this->retry_base_delay_ms = base_delay_ms < 1 ? 1 : base_delay_ms;
+    this->retry_max_delay_ms = max_delay_ms < this->retry_base_delay_ms ? this->retry_base_delay_ms : max_delay_ms;
+}
+
+/**
+ * @brief Limits which responses are worth downloading.
+ *
+ * A successful response declaring a Content-Type outside `accepted_types`, or a
+ * Content-Length above `max_body_bytes`, is aborted as soon as its headers arrive, before
+ * any of the body is transferred. Bodies without a Content-Length are aborted as soon as
+ * they grow past the cap. Such transfers fail with UNWANTED_CONTENT_TYPE or BODY_TOO_LARGE
+ * and are not retried. By default bodies are capped at 32 MiB and only HTML and plain text
+ * are accepted.
+ *
+ * @param max_body_bytes The largest decoded body to receive, or 0 for no limit.
+ * @param accepted_types The media types to accept, such as "text/html", or empty to accept any.
+ */
+void CurlManager::set_content_limits(size_t max_body_bytes, const std::vector<std::string>& accepted_types)
+{
+    this->max_body_bytes = max_body_bytes;
+    this->accepted_types = accepted_types;
+
+    for (std::string& type : this->accepted_types)
+    {
+        to_lower_ascii(type);
+    }
+}
+
+/**
+ * @brief Enables or disables hedged requests on the multi handle.
+ *
+ * When a transfer has not received its first byte within the given percentile of recently
+ * observed times to first byte, a duplicate request is launched and whichever attempt
+ * succeeds first is delivered, with the other cancelled. This trims the latency tail caused
+ * by a slow server or edge. Duplicates are capped at `budget_percent` of all requests, so
+ * hedging never adds more than that share of load. Streamed transfers are never hedged.
+ *
+ * @param enabled Whether to hedge slow transfers.
+ * @param percentile The percentile of time to first byte after which to hedge, between 0 and 1.
+ * @param budget_percent The maximum number of duplicates as a percentage of requests.
+ */
+void CurlManager::set_hedging(bool enabled, double percentile, double budget_percent)
+{
+    this->hedging = enabled;
+    this->hedge_percentile = percentile < 0 ? 0 : (percentile > 1 ? 1 : percentile);
+    this->hedge_budget_percent = budget_percent < 0 ? 0 : budget_percent;
+}
+
+/**
+ * @brief Returns the current hedge delay in milliseconds, or -1 until enough samples exist.
+ */
+long long CurlManager::get_hedge_delay_ms()
+{
+    return this->hedge_delay_ms;
+}
+
+/**
+ * @brief Returns the timing histograms of every transfer completed so far, per host and overall.
+ *
+ * Every attempt is recorded, including failed ones and retries, with the name lookup, connect,
+ * TLS handshake, first byte and total times libcurl measured for it.
+ */
+TransferStats& CurlManager::get_transfer_stats()
+{
+    return this->transfer_stats;
+}
+
+/**
+ * @brief Enables or disables HTTP/2 multiplexing for concurrent transfers.
+ *
+ * When enabled, requests negotiate HTTP/2 over TLS and transfers to the same origin wait
+ * for and share a single connection, running as concurrent streams on it instead of each
+ * opening their own connection and TLS session. Origins that only speak HTTP/1.1 keep
+ * opening one connection per transfer, bounded by the per-host limits of the scheduler.
+ *
+ * @param enabled Whether to multiplex transfers over HTTP/2.
+ * @param max_streams_per_host The maximum number of concurrent streams on each origin's connection.
+ */
+void CurlManager::set_http2(bool enabled, long max_streams_per_host)
+{
+    this->http2 = enabled;
+
+    if (enabled)
+    {
+        curl_multi_setopt(this->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(this->multi, CURLMOPT_MAX_CONCURRENT_STREAMS, max_streams_per_host < 1 ? 1L : max_streams_per_host);
+    }
+    else
+    {
+        // Stop multiplexing and restore libcurl's default stream limit
+        curl_multi_setopt(this->multi, CURLMOPT_PIPELINING, CURLPIPE_NOTHING);
+        curl_multi_setopt(this->multi, CURLMOPT_MAX_CONCURRENT_STREAMS, 100L);
+    }
+}
+
+/**
+ * @brief Waits for socket activity through epoll and lets libcurl act on the ready sockets.
+ *
+ * The wait is shortened to libcurl's own timer when that expires sooner, and the timer is
+ * fired once its deadline has passed even if sockets kept the wait from timing out.
+ *
+ * @param timeout_ms The maximum time to wait for activity, in milliseconds.
+ * @return int The number of transfers libcurl reports as still running.
+ */
+int CurlManager::wait_sockets(int timeout_ms)
+{
+    int running = 0;
+
+#ifdef __linux__
+    int wait_ms = timeout_ms;
+    if (this->timer_deadline_ms != -1)
+    {
+        long long remaining = this->timer_deadline_ms - now_ms();
+        if (remaining < 0)
+        {
+            remaining = 0;
+        }
+        if (remaining < wait_ms)
+        {
+            wait_ms = static_cast<int>(remaining);
+        }
+    }
+
+    epoll_event events[256];
+    int count = epoll_wait(this->epoll_fd, events, 256, wait_ms);
+
+    for (int i = 0; i < count; i++)
+    {
+        int flags = 0;
+        if (events[i].events & EPOLLIN)
+        {
+            flags |= CURL_CSELECT_IN;
+        }
+        if (events[i].events & EPOLLOUT)
+        {
+            flags |= CURL_CSELECT_OUT;
+        }
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+        {
+            flags |= CURL_CSELECT_ERR;
+        }
+
+        curl_multi_socket_action(this->multi, events[i].data.fd, flags, &running);
+    }
+
+    if (this->timer_deadline_ms != -1 && now_ms() >= this->timer_deadline_ms)
+    {
+        this->timer_deadline_ms = -1;
+        curl_multi_socket_action(this->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    }
+#endif
+
+    return running;
+}
+
+/**
+ * @brief Called by libcurl to add, update or remove a socket in the epoll set.
+ */
+int CurlManager::socket_callback(CURL* /* easy */, curl_socket_t socket, int what, void* userp, void* socketp)
+{
+#ifdef __linux__
+    CurlManager* manager = static_cast<CurlManager*>(userp);
+
+    if (what == CURL_POLL_REMOVE)
+    {
+        epoll_ctl(manager->epoll_fd, EPOLL_CTL_DEL, socket, nullptr);
+        curl_multi_assign(manager->multi, socket, nullptr);
+        return 0;
+    }
+
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.data.fd = socket;
+    if (what & CURL_POLL_IN)
+    {
+        event.events |= EPOLLIN;
+    }
+    if (what & CURL_POLL_OUT)
+    {
+        event.events |= EPOLLOUT;
+    }
+
+    if (socketp == nullptr)
+    {
+        epoll_ctl(manager->epoll_fd, EPOLL_CTL_ADD, socket, &event);
+        curl_multi_assign(manager->multi, socket, manager);
+    }
+    else
+    {
+        epoll_ctl(manager->epoll_fd, EPOLL_CTL_MOD, socket, &event);
+    }
+#else
+    (void)socket;
+    (void)what;
+    (void)userp;
+    (void)socketp;
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief Called by libcurl to (re)arm or cancel its single timeout.
+ */
+int CurlManager::timer_callback(CURLM* /* multi */, long timeout_ms, void* userp)
+{
+    CurlManager* manager = static_cast<CurlManager*>(userp);
+
+    manager->timer_deadline_ms = timeout_ms < 0 ? -1 : now_ms() + timeout_ms;
+
+    return 0;
+}
+
+/**
+ * @brief Called by libcurl before a handle touches data held in the share object.
+ *
+ * Each kind of shared data has its own mutex, so a DNS lookup on one thread never waits
+ * on a TLS session being stored by another.
+ */
+void CurlManager::share_lock(CURL* /* easy */, curl_lock_data data, curl_lock_access /* access */, void* userp)
+{
+    CurlManager* manager = static_cast<CurlManager*>(userp);
+    manager->share_locks[data].lock();
+}
+
+/**
+ * @brief Called by libcurl once a handle has finished with data held in the share object.
+ */
+void CurlManager::share_unlock(CURL* /* easy */, curl_lock_data data, void* userp)
+{
+    CurlManager* manager = static_cast<CurlManager*>(userp);
+    manager->share_locks[data].unlock();
+}
+
+/**
+ * @brief Moves queued transfers onto the multi handle until the in-flight limit is reached.
+ */
+void CurlManager::start_pending()
+{
+    // Requeue retries whose backoff delay has passed
+    long long now = now_ms();
+    while (!this->retries.empty() && this->retries.begin()->first <= now)
+    {
+        Transfer* retry = this->retries.begin()->second;
+        this->retries.erase(this->retries.begin());
+        this->pending.push(retry->host, retry);
+    }
+
+    Transfer* transfer = nullptr;
+    std::string host;
+
+    int limit = this->get_concurrency_limit();
+    while (this->in_flight < limit && this->pending.pop_ready(now_ms(), transfer, host))
+    {
+        this->launch_transfer(transfer);
+        this->requests_started++;
+
+        // Streams cannot be hedged, as both attempts would feed the same consumer
+        if (this->hedging && !transfer->on_chunk)
+        {
+            transfer->hedge_position = this->hedge_candidates.insert(this->hedge_candidates.end(), transfer);
+            transfer->hedge_listed = true;
+        }
+    }
+}
+
+/**
+ * @brief Starts a transfer on a pooled easy handle and adds it to the multi handle.
+ *
+ * Easy handles of finished transfers are kept and reused, so their connections stay alive
+ * for later requests to the same host.
+ *
+ * @param transfer The transfer to start.
+ */
+void CurlManager::launch_transfer(Transfer* transfer)
+{
+    if (this->free_handles.empty())
+    {
+        transfer->easy = curl_easy_init();
+    }
+    else
+    {
+        transfer->easy = this->free_handles.back();
+        this->free_handles.pop_back();
+        curl_easy_reset(transfer->easy);
+    }
+
+    if (!transfer->on_chunk)
+    {
+        transfer->html_content = new std::string();
+    }
+
+    this->attach_transfer(*transfer);
+    curl_easy_setopt(transfer->easy, CURLOPT_PRIVATE, transfer);
+
+    transfer->started_ms = now_ms();
+    transfer->first_byte_ms = -1;
+
+    curl_multi_add_handle(this->multi, transfer->easy);
+    transfer->active_position = this->active.insert(this->active.end(), transfer);
+    this->in_flight++;
+
+    LOG("Started GET request to: ", transfer->url.c_str());
+}
+
+/**
+ * @brief Launches a duplicate attempt for transfers still waiting on their first byte.
+ *
+ * A transfer becomes eligible once it has waited longer than the hedge delay without
+ * receiving a response byte. The duplicate runs alongside it, and whichever succeeds first
+ * is delivered while the other is cancelled. Duplicates may go beyond the in-flight limit,
+ * but no more are started than the budget allows as a share of all requests. A duplicate
+ * takes a token and a connection of its host like any other request, and is skipped when
+ * the host's rate or connection limit has none to spare.
+ */
+void CurlManager::start_hedges()
+{
+    if (!this->hedging || this->hedge_delay_ms < 0)
+    {
+        return;
+    }
+
+    long long now = now_ms();
+
+    // Candidates are in start order, so the oldest ones are at the front
+    while (!this->hedge_candidates.empty() && this->hedge_candidates.front()->started_ms + this->hedge_delay_ms <= now)
+    {
+        Transfer* transfer = this->hedge_candidates.front();
+        this->hedge_candidates.pop_front();
+        transfer->hedge_listed = false;
+
+        if (transfer->first_byte_ms != -1 || transfer->twin != nullptr)
+        {
+            continue;
+        }
+
+        if ((this->hedges_started + 1) * 100.0 > this->hedge_budget_percent * this->requests_started)
+        {
+            continue;
+        }
+
+        // Throttled hosts, including those slowed by a robots.txt Crawl-delay, are not hedged
+        if (!this->pending.try_acquire(transfer->host, now))
+        {
+            continue;
+        }
+
+        LOG("Hedging slow GET request to: ", transfer->url.c_str());
+
+        Transfer* hedge = new Transfer();
+        hedge->url = transfer->url;
+        hedge->host = transfer->host;
+        hedge->html_content = nullptr;
+        hedge->on_complete = transfer->on_complete;
+        // Launching counts as the same attempt as the one it duplicates
+        hedge->attempts = transfer->attempts - 1;
+        hedge->twin = transfer;
+        transfer->twin = hedge;
+
+        this->launch_transfer(hedge);
+        this->hedges_started++;
+    }
+}
+
+/**
+ * @brief Aborts an in-flight transfer without delivering it.
+ *
+ * @param transfer The transfer to cancel, which is deleted.
+ */
+void CurlManager::cancel_transfer(Transfer* transfer)
+{
+    LOG("Cancelling GET request to: ", transfer->url.c_str());
+
+    curl_multi_remove_handle(this->multi, transfer->easy);
+    this->active.erase(transfer->active_position);
+    this->in_flight--;
+    this->pending.release(transfer->host, now_ms());
+
+    if (transfer->hedge_listed)
+    {
+        this->hedge_candidates.erase(transfer->hedge_position);
+    }
+
+    this->free_handles.push_back(transfer->easy);
+    curl_slist_free_all(transfer->request_headers);
+    delete transfer->html_content;
+    delete transfer;
+}
+
+/**
+ * @brief Feeds the outcome of a completed transfer to the adaptive concurrency limiters.
+ *
+ * The round trip is the time to first byte, so large bodies do not read as congestion.
+ * Transient failures count as dropped requests; permanent ones say nothing about load.
+ *
+ * @param transfer The completed transfer, already released from the host scheduler.
+ * @param result The result of the transfer.
+ */
+void CurlManager::adapt_concurrency(const Transfer& transfer, const FetchResult& result)
+{
+    long long now = now_ms();
+    long long rtt_ms = transfer.first_byte_ms != -1 ? transfer.first_byte_ms - transfer.started_ms : now - transfer.started_ms;
+    // A 304 refetched because its cached body was lost says nothing about load either
+    bool dropped = result.fetch_code == FetchCode::TRANSIENT_FETCH_ERROR && result.status != 304;
+
+    auto found = this->host_limiters.find(transfer.host);
+    if (found == this->host_limiters.end())
+    {
+        found = this->host_limiters.emplace(transfer.host, ConcurrencyLimiter(4, 1, this->max_host_limit)).first;
+    }
+
+    // Both counts include the transfer that just completed
+    found->second.on_sample(rtt_ms, dropped, this->pending.active(transfer.host) + 1, now);
+    this->global_limiter.on_sample(rtt_ms, dropped, this->in_flight + 1, now, false);
+
+    this->pending.set_host_connections(transfer.host, found->second.limit());
+}
+
+/**
+ * @brief Records the time to first byte of a successful transfer.
+ *
+ * The hedge delay is the configured percentile of the most recent samples, recomputed
+ * every few samples once enough have been collected.
+ *
+ * @param first_byte_ms The time from starting the transfer to its first response byte.
+ */
+void CurlManager::record_first_byte(long long first_byte_ms)
+{
+    const size_t MAX_SAMPLES = 512;
+    const int UPDATE_INTERVAL = 32;
+
+    if (this->first_byte_samples.size() < MAX_SAMPLES)
+    {
+        this->first_byte_samples.push_back(first_byte_ms);
+    }
+    else
+    {
+        this->first_byte_samples[this->next_sample] = first_byte_ms;
+        this->next_sample = (this->next_sample + 1) % MAX_SAMPLES;
+    }
+
+    if (++this->samples_since_update < UPDATE_INTERVAL)
+    {
+        return;
+    }
+
+    this->samples_since_update = 0;
+
+    std::vector<long long> sorted = this->first_byte_samples;
+    size_t rank = static_cast<size_t>(this->hedge_percentile * (sorted.size() - 1));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    this->hedge_delay_ms = sorted[rank];
+}
+
+/**
+ * @brief Applies the options shared by every request to an easy handle.
+ *
+ * Both the per-thread handles used by `get` and the pooled handles on the multi handle
+ * are configured here after being reset, before any per-request options are set.
+ *
+ * @param easy The easy handle to configure.
+ */
+void CurlManager::configure_handle(CURL* easy)
+{
+    // Signals cannot be used for timeouts when several threads run transfers
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(easy, CURLOPT_SHARE, this->share);
+
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, this->connect_timeout_ms);
+    curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, this->low_speed_bytes);
+    curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, this->low_speed_seconds);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, this->total_timeout_ms);
+
+    if (this->compression)
+    {
+        // An empty string offers every encoding libcurl can decode, which it inflates as the body streams in
+        curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, "");
+    }
+
+    if (this->http2)
+    {
+        curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+        // Wait for an existing connection to the origin to multiplex on rather than opening another
+        curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+    }
+}
+
+/**
+ * @brief Sets up an easy handle to perform a transfer.
+ *
+ * The handle receives the common options from `configure_handle`, followed by the URL and
+ * the callbacks that deliver the response to the transfer. When a disk cache is attached and
+ * holds the URL, the cached validators are sent as conditional request headers; streamed
+ * transfers skip this, as a 304 response would leave them with no body to stream.
+ *
+ * @param transfer The transfer to perform, whose easy handle has been reset.
+ */
+void CurlManager::attach_transfer(Transfer& transfer)
+{
+    transfer.manager = this;
+    transfer.attempts++;
+    transfer.decoded_bytes = 0;
+    transfer.retry_after_ms = -1;
+    transfer.rejection = FetchCode::NO_FETCH_ERROR;
+    transfer.response_headers.clear();
+
+    this->configure_handle(transfer.easy);
+
+    // Set the URL to request
+    curl_easy_setopt(transfer.easy, CURLOPT_URL, transfer.url.c_str());
+
+    if (transfer.max_redirects > 0)
+    {
+        curl_easy_setopt(transfer.easy, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(transfer.easy, CURLOPT_MAXREDIRS, transfer.max_redirects);
+    }
+
+    // Set the callback functions to handle the response headers and data
+    curl_easy_setopt(transfer.easy, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(transfer.easy, CURLOPT_HEADERDATA, &transfer);
+    curl_easy_setopt(transfer.easy, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(transfer.easy, CURLOPT_WRITEDATA, &transfer);
+
+    CacheValidators cached;
+    transfer.conditional = CacheValidators();
+    if (this->http_cache != nullptr && !transfer.on_chunk && !transfer.unconditional && this->http_cache->lookup(transfer.url, cached))
+    {
+        transfer.conditional = cached;
+
+        if (!cached.etag.empty())
+        {
+            transfer.request_headers = curl_slist_append(transfer.request_headers, ("If-None-Match: " + cached.etag).c_str());
+        }
+        if (!cached.last_modified.empty())
+        {
+            transfer.request_headers = curl_slist_append(transfer.request_headers, ("If-Modified-Since: " + cached.last_modified).c_str());
+        }
+
+        curl_easy_setopt(transfer.easy, CURLOPT_HTTPHEADER, transfer.request_headers);
+    }
+}
+
+/**
+ * @brief Builds the result of a finished transfer from its handle and body.
+ *
+ * The outcome is classified as transient or permanent from the libcurl result and the HTTP
+ * status, and a failed transfer, including one answered with an HTTP error status, has its
+ * body freed and is reported with a nullptr body. With a disk cache attached, a 304 response is answered with the
+ * cached body, and a fresh response carrying validators is written to the cache. A 304 whose
+ * cached body cannot be loaded is reported as a transient failure, for `should_retry` to
+ * refetch it unconditionally.
+ *
+ * @param transfer The finished transfer, whose easy handle is still valid.
+ * @param code The libcurl result of the transfer.
+ * @return FetchResult The result, owning the transfer's body on success.
+ */
+FetchResult CurlManager::complete_transfer(Transfer& transfer, CURLcode code)
+{
+    FetchResult result;
+    result.url = transfer.url;
+    result.code = code;
+    result.status = 0;
+    result.attempts = transfer.attempts;
+    result.wire_bytes = 0;
+    result.decoded_bytes = transfer.decoded_bytes;
+    result.from_cache = false;
+    result.headers.swap(transfer.response_headers);
+    curl_easy_getinfo(transfer.easy, CURLINFO_RESPONSE_CODE, &result.status);
+    curl_easy_getinfo(transfer.easy, CURLINFO_SIZE_DOWNLOAD_T, &result.wire_bytes);
+    this->transfer_stats.record(transfer.easy, transfer.host);
+
+    curl_slist_free_all(transfer.request_headers);
+    transfer.request_headers = nullptr;
+
+    result.fetch_code = transfer.rejection != FetchCode::NO_FETCH_ERROR ? transfer.rejection : classify_transfer(code, result.status);
+
+    if (result.fetch_code == FetchCode::NO_FETCH_ERROR)
+    {
+        result.html_content = transfer.html_content;
+    }
+    else
+    {
+        if (transfer.rejection != FetchCode::NO_FETCH_ERROR)
+        {
+            LOG("Rejected response from: ", transfer.url.c_str(), " - ", transfer.content_type.c_str(), ", ", transfer.decoded_bytes, " bytes");
+        }
+        else if (code != CURLE_OK)
+        {
+            LOG("Failed to get HTML from: ", transfer.url.c_str(), " - ", curl_easy_strerror(code));
+        }
+        else
+        {
+            LOG("Failed to get HTML from: ", transfer.url.c_str(), " - HTTP ", result.status);
+        }
+        delete transfer.html_content;
+        result.html_content = nullptr;
+    }
+
+    transfer.html_content = nullptr;
+
+    if (this->http_cache != nullptr && result.html_content != nullptr)
+    {
+        if (result.status == 304)
+        {
+            LOG("Reusing cached body for: ", transfer.url.c_str());
+            delete result.html_content;
+            result.html_content = this->http_cache->load(transfer.url, transfer.conditional);
+            result.from_cache = result.html_content != nullptr;
+            result.decoded_bytes = result.from_cache ? result.html_content->size() : 0;
+
+            if (result.html_content == nullptr)
+            {
+                // Ask again without validators. A server that still answers 304 gets no more tries
+                LOG("Cached body lost, refetching: ", transfer.url.c_str());
+                result.fetch_code = transfer.unconditional ? FetchCode::PERMANENT_FETCH_ERROR : FetchCode::TRANSIENT_FETCH_ERROR;
+                transfer.unconditional = true;
+            }
+        }
+        else if (result.status == 200 && (!transfer.validators.etag.empty() || !transfer.validators.last_modified.empty()))
+        {
+            this->http_cache->store(transfer.url, transfer.validators, *result.html_content);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Decides whether a failed transfer should be attempted again.
+ *
+ * Only transient failures are retried, up to the configured number of attempts. A streamed
+ * transfer that already delivered part of its body to the consumer is never retried. A 304
+ * whose cached body could not be loaded is always refetched once, without validators.
+ */
+bool CurlManager::should_retry(const Transfer& transfer, const FetchResult& result)
+{
+    if (result.status == 304 && result.fetch_code == FetchCode::TRANSIENT_FETCH_ERROR)
+    {
+        return true;
+    }
+
+    if (result.fetch_code != FetchCode::TRANSIENT_FETCH_ERROR || transfer.attempts >= this->max_attempts)
+    {
+        return false;
+    }
+
+    return !(transfer.on_chunk && transfer.decoded_bytes > 0);
+}
+
+/**
+ * @brief Picks the delay before the next attempt of a transfer.
+ *
+ * The delay grows exponentially with each attempt up to the configured maximum, and is
+ * jittered between half and all of that, so transfers that failed together do not retry in
+ * lockstep. A longer delay asked for by a Retry-After header is honoured up to the maximum.
+ * The unconditional refetch after a 304 whose cached body could not be loaded starts at once.
+ */
+long long CurlManager::retry_delay_ms(const Transfer& transfer, const FetchResult& result)
+{
+    // Refetching a page whose cached copy was lost is not backing off from a failure
+    if (result.status == 304)
+    {
+        return 0;
+    }
+
+    static thread_local std::mt19937 generator(std::random_device{}());
+
+    long long ceiling = this->retry_base_delay_ms;
+    for (int i = 1; i < transfer.attempts && ceiling < this->retry_max_delay_ms; i++)
+    {
+        ceiling *= 2;
+    }
+    if (ceiling > this->retry_max_delay_ms)
+    {
+        ceiling = this->retry_max_delay_ms;
+    }
+
+    std::uniform_int_distribution<long long> jitter(ceiling / 2, ceiling);
+    long long delay_ms = jitter(generator);
+
+    if (transfer.retry_after_ms > delay_ms)
+    {
+        delay_ms = transfer.retry_after_ms < this->retry_max_delay_ms ? transfer.retry_after_ms : this->retry_max_delay_ms;
+    }
+
+    return delay_ms;
+}
+
+/**
+ * @brief Hands the results of finished transfers to their callbacks.
+ *
+ * Each finished easy handle is removed from the multi handle and returned to the free list.
+ * Transfers that failed transiently are parked in the retry queue until their backoff delay
+ * has passed, instead of being delivered.
+ */
+void CurlManager::collect_completed()
+{
+    CURLMsg* msg = nullptr;
+    int queued = 0;
+
+    while ((msg = curl_multi_info_read(this->multi, &queued)) != nullptr)
+    {
+        if (msg->msg != CURLMSG_DONE)
+        {
+            continue;
+        }
+
+        Transfer* transfer = nullptr;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+        CURLcode code = msg->data.result;
+
+        curl_multi_remove_handle(this->multi, transfer->easy);
+        this->active.erase(transfer->active_position);
+        this->in_flight--;
+        this->pending.release(transfer->host, now_ms());
+
+        if (transfer->hedge_listed)
+        {
+            this->hedge_candidates.erase(transfer->hedge_position);
+            transfer->hedge_listed = false;
+        }
+
+        FetchResult result = this->complete_transfer(*transfer, code);
+        this->free_handles.push_back(transfer->easy);
+        transfer->easy = nullptr;
+
+        if (result.fetch_code == FetchCode::NO_FETCH_ERROR && transfer->first_byte_ms != -1)
+        {
+            this->record_first_byte(transfer->first_byte_ms - transfer->started_ms);
+        }
+
+        if (this->adaptive)
+        {
+            this->adapt_concurrency(*transfer, result);
+        }
+
+        if (transfer->twin != nullptr)
+        {
+            Transfer* twin = transfer->twin;
+            twin->twin = nullptr;
+            transfer->twin = nullptr;
+
+            if (result.fetch_code != FetchCode::NO_FETCH_ERROR)
+            {
+                // The other attempt may still succeed, so it carries on alone
+                delete result.html_content;
+                delete transfer;
+                continue;
+            }
+
+            cancel_transfer(twin);
+        }
+
+        if (this->should_retry(*transfer, result))
+        {
+            // Park the transfer instead of sleeping, so other transfers keep running meanwhile
+            long long delay_ms = this->retry_delay_ms(*transfer, result);
+            LOG("Retrying GET request to: ", transfer->url.c_str(), " in ", delay_ms, "ms");
+            this->retries.insert(std::make_pair(now_ms() + delay_ms, transfer));
+            continue;
+        }
+
+        if (transfer->on_complete)
+        {
+            transfer->on_complete(result);
+        }
+        else
+        {
+            delete result.html_content;
+        }
+
+        delete transfer;
+    }
+}
+
+/**
+ * @brief Called by libcurl with each response header line.
+ *
+ * The lines are kept for the FetchResult. The ETag and Last-Modified validators are captured
+ * for the disk cache, a Retry-After delay for the retry backoff and the Content-Type for
+ * `accept_response`. They are all cleared at each status line, so only those of the final
+ * response after any interim ones are kept.
+ * Once the headers are complete, returning 0 aborts an unwanted response before its body.
+ */
+size_t CurlManager::header_callback(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    size_t realsize = size * nitems;
+    Transfer* transfer = static_cast<Transfer*>(userdata);
+
+    std::string line(buffer, realsize);
+    while (!line.empty() && (line.back() == '\r' || line.back() == '\n'))
+    {
+        line.pop_back();
+    }
+
+    if (line.compare(0, 5, "HTTP/") == 0)
+    {
+        if (transfer->first_byte_ms == -1)
+        {
+            transfer->first_byte_ms = now_ms();
+        }
+
+        transfer->validators = CacheValidators();
+        transfer->retry_after_ms = -1;
+        transfer->content_type.clear();
+        transfer->content_encoded = false;
+        transfer->response_headers = line;
+        return realsize;
+    }
+
+    // The blank line closing the headers
+    if (line.empty())
+    {
+        return transfer->manager->accept_response(*transfer) ? realsize : 0;
+    }
+
+    transfer->response_headers += "\r\n";
+    transfer->response_headers += line;
+
+    size_t colon = line.find(':');
+    if (colon == std::string::npos)
+    {
+        return realsize;
+    }
+
+    std::string name = line.substr(0, colon);
+    to_lower_ascii(name);
+
+    size_t value_start = line.find_first_not_of(" \t", colon + 1);
+    std::string value = value_start == std::string::npos ? "" : line.substr(value_start);
+
+    if (name == "retry-after")
+    {
+        // Only the delay-seconds form; an HTTP-date falls back to the normal backoff
+        if (!value.empty() && value.find_first_not_of("0123456789") == std::string::npos)
+        {
+            transfer->retry_after_ms = std::atoll(value.c_str()) * 1000;
+        }
+    }
+    else if (name == "content-type")
+    {
+        transfer->content_type = value.substr(0, value.find(';'));
+        while (!transfer->content_type.empty() && (transfer->content_type.back() == ' ' || transfer->content_type.back() == '\t'))
+        {
+            transfer->content_type.pop_back();
+        }
+        to_lower_ascii(transfer->content_type);
+    }
+    else if (name == "content-encoding")
+    {
+        transfer->content_encoded = !value.empty() && value != "identity";
+    }
+    else if (name == "etag")
+    {
+        transfer->validators.etag = value;
+    }
+    else if (name == "last-modified")
+    {
+        transfer->validators.last_modified = value;
+    }
+
+    return realsize;
+}
+
+/**
+ * @brief Decides, once the headers are in, whether the body of a response is worth receiving.
+ *
+ * Only successful responses are checked, so redirects and error pages are never rejected
+ * here, and neither are unfiltered transfers. A response is rejected if it declares a Content-Type outside the accepted types or a
+ * Content-Length above the body cap.
+ *
+ * @param transfer The transfer whose headers have just been received.
+ * @return true to receive the body, false to abort the transfer.
+ */
+bool CurlManager::accept_response(Transfer& transfer)
+{
+    if (transfer.unfiltered)
+    {
+        return true;
+    }
+
+    long status = 0;
+    curl_easy_getinfo(transfer.easy, CURLINFO_RESPONSE_CODE, &status);
+    if (status < 200 || status >= 300)
+    {
+        return true;
+    }
+
+    if (!transfer.content_type.empty() && !this->accepted_types.empty() &&
+        std::find(this->accepted_types.begin(), this->accepted_types.end(), transfer.content_type) == this->accepted_types.end())
+    {
+        transfer.rejection = FetchCode::UNWANTED_CONTENT_TYPE;
+        return false;
+    }
+
+    curl_off_t content_length = -1;
+    curl_easy_getinfo(transfer.easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length);
+    if (this->max_body_bytes > 0 && content_length > 0 && static_cast<size_t>(content_length) > this->max_body_bytes)
+    {
+        transfer.rejection = FetchCode::BODY_TOO_LARGE;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Called by libcurl with each chunk of a response body.
+ *
+ * Transfers whose body grows past the cap are aborted. Streamed transfers hand the chunk
+ * straight to their consumer; all others append it to their body buffer. On the first chunk the buffer is reserved from the response's
+ * Content-Length when the server sent one, so the body is received without reallocating.
+ * Otherwise the buffer grows geometrically.
+ */
+size_t CurlManager::write_callback(void* ptr, size_t size, size_t nmemb, void* userdata) {
+    size_t realsize = size * nmemb;
+    Transfer* transfer = static_cast<Transfer*>(userdata);
+    transfer->decoded_bytes += realsize;
+
+    // Bodies without a Content-Length, or that inflate past it, are cut off as they grow
+    size_t max_body_bytes = transfer->unfiltered ? 0 : transfer->manager->max_body_bytes;
+    if (max_body_bytes > 0 && transfer->decoded_bytes > max_body_bytes)
+    {
+        transfer->rejection = FetchCode::BODY_TOO_LARGE;
+        return 0;
+    }
+
+    if (transfer->on_chunk)
+    {
+        // Returning less than realsize makes libcurl abort the transfer
+        return transfer->on_chunk(static_cast<char*>(ptr), realsize) ? realsize : 0;
+    }
+
+    if (transfer->html_content->empty())
+    {
+        curl_off_t content_length = -1;
+        curl_easy_getinfo(transfer->easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length);
+
+        // The Content-Length of a compressed body is its size on the wire
+        if (transfer->content_encoded && content_length > 0)
+        {
+            content_length = std::min(content_length * ENCODED_RESERVE_RATIO, MAX_RESERVE_BYTES);
+            if (max_body_bytes > 0)
+            {
+                content_length = std::min(content_length, static_cast<curl_off_t>(max_body_bytes));
+            }
+        }
+
+        if (content_length > 0 && content_length <= MAX_RESERVE_BYTES)
+        {
+            transfer->html_content->reserve(static_cast<size_t>(content_length));
+        }
+    }
 
     // Append received data to the string
-    html_content->append(static_cast<char*>(ptr), realsize);
+    transfer->html_content->append(static_cast<char*>(ptr), realsize);
 
     return realsize;
 }
\ No newline at end of file
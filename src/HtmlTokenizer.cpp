@@ -0,0 +1,334 @@
+#include <HtmlTokenizer.hpp>
+
+
+/**
+ * @brief Checks whether a byte is HTML whitespace.
+ */
+static inline bool is_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f';
+}
+
+/**
+ * @brief Checks whether a byte is an ASCII letter.
+ */
+static inline bool is_alpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/**
+ * @brief Compares two ASCII strings, ignoring case.
+ */
+static bool equals_ignore_case(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if ((a[i] | 0x20) != (b[i] | 0x20))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Constructs a new HtmlTokenizer object.
+ *
+ * @param html The document to tokenize.
+ * @param start The offset to start tokenizing from.
+ */
+HtmlTokenizer::HtmlTokenizer(std::string_view html, size_t start)
+    : scanner(html, structural_mask(LESS_THAN) | structural_mask(GREATER_THAN) | structural_mask(DOUBLE_QUOTE) | structural_mask(SINGLE_QUOTE))
+{
+    this->html = html;
+    this->pos = start;
+    this->walked = 0;
+}
+
+/**
+ * @brief Destructor for the HtmlTokenizer class.
+ */
+HtmlTokenizer::~HtmlTokenizer()
+{
+}
+
+/**
+ * @brief Returns the offset the next token will start at.
+ */
+size_t HtmlTokenizer::position() const
+{
+    return this->pos;
+}
+
+/**
+ * @brief Reads the next token.
+ *
+ * @param token Receives the token.
+ * @return true if a token was read, false at the end of the document.
+ */
+bool HtmlTokenizer::next(HtmlToken& token)
+{
+    if (this->pos >= this->html.size())
+    {
+        return false;
+    }
+
+    if (!this->raw_text_tag.empty())
+    {
+        return this->read_raw_text(token);
+    }
+
+    if (this->html[this->pos] != '<')
+    {
+        size_t next_tag = this->find(this->pos, '<');
+        this->read_text(token, next_tag == std::string_view::npos ? this->html.size() : next_tag);
+        return true;
+    }
+
+    if (this->read_tag(token))
+    {
+        return true;
+    }
+
+    // A '<' that does not start a tag is ordinary text, up to the next '<'
+    size_t next_tag = this->find(this->pos + 1, '<');
+    this->read_text(token, next_tag == std::string_view::npos ? this->html.size() : next_tag);
+    return true;
+}
+
+/**
+ * @brief Returns the first `delimiter` at or after `from`, or npos if there is none.
+ */
+size_t HtmlTokenizer::find(size_t from, char delimiter)
+{
+    // Most searches start where the walk already is, at the byte after the last delimiter
+    if (from != this->walked)
+    {
+        this->scanner.seek(from);
+    }
+    return this->find_next(delimiter);
+}
+
+/**
+ * @brief Returns the next `delimiter` the scanner reaches, skipping the other delimiters.
+ */
+size_t HtmlTokenizer::find_next(char delimiter)
+{
+    size_t offset = this->next_delimiter();
+    while (offset != std::string_view::npos && this->html[offset] != delimiter)
+    {
+        offset = this->next_delimiter();
+    }
+    return offset;
+}
+
+/**
+ * @brief Returns the next delimiter of any kind the scanner reaches.
+ */
+size_t HtmlTokenizer::next_delimiter()
+{
+    size_t offset = this->scanner.next();
+    this->walked = offset == std::string_view::npos ? this->html.size() : offset + 1;
+    return offset;
+}
+
+/**
+ * @brief Emits the text from the current position up to `end`, exclusive.
+ */
+void HtmlTokenizer::read_text(HtmlToken& token, size_t end)
+{
+    token.type = HtmlTokenType::TEXT_TOKEN;
+    token.name = std::string_view();
+    token.text = this->html.substr(this->pos, end - this->pos);
+    token.start = this->pos;
+    token.end = end - 1;
+    this->pos = end;
+}
+
+/**
+ * @brief Reads the tag, comment or declaration starting at the current '<'.
+ *
+ * @return false if the '<' does not start one, leaving the position unchanged.
+ */
+bool HtmlTokenizer::read_tag(HtmlToken& token)
+{
+    const std::string_view& html = this->html;
+    size_t start = this->pos;
+    size_t size = html.size();
+
+    if (start + 1 >= size)
+    {
+        return false;
+    }
+
+    char first = html[start + 1];
+
+    // Comments run to the first "-->", whatever they contain
+    if (first == '!' && html.compare(start + 2, 2, "--") == 0)
+    {
+        size_t close = this->find(start + 6, '>');
+        while (close != std::string_view::npos && (html[close - 1] != '-' || html[close - 2] != '-'))
+        {
+            close = this->find_next('>');
+        }
+        size_t end = close == std::string_view::npos ? size - 1 : close;
+
+        token.type = HtmlTokenType::COMMENT_TOKEN;
+        token.name = std::string_view();
+        token.text = html.substr(start, end - start + 1);
+        token.start = start;
+        token.end = end;
+        this->pos = end + 1;
+        return true;
+    }
+
+    // Declarations, processing instructions and malformed closing tags run to the first '>'
+    bool closing = first == '/';
+    if (first == '!' || first == '?' || (closing && (start + 2 >= size || !is_alpha(html[start + 2]))))
+    {
+        size_t close = this->find(start + 1, '>');
+        size_t end = close == std::string_view::npos ? size - 1 : close;
+
+        token.type = first == '/' ? HtmlTokenType::COMMENT_TOKEN : HtmlTokenType::DECLARATION_TOKEN;
+        token.name = std::string_view();
+        token.text = html.substr(start, end - start + 1);
+        token.start = start;
+        token.end = end;
+        this->pos = end + 1;
+        return true;
+    }
+
+    if (!closing && !is_alpha(first))
+    {
+        return false;
+    }
+
+    // The name runs to the first whitespace, '/' or '>'
+    size_t name_start = start + (closing ? 2 : 1);
+    size_t name_end = name_start;
+    while (name_end < size && !is_space(html[name_end]) && html[name_end] != '/' && html[name_end] != '>')
+    {
+        name_end++;
+    }
+
+    // Skip the attributes to the closing '>', stepping over quoted values. Delimiters in the
+    // name are skipped the same way, so the walk can carry on from the '<'
+    if (this->walked != start + 1)
+    {
+        this->scanner.seek(name_end);
+    }
+    size_t end = this->next_delimiter();
+    while (end != std::string_view::npos && html[end] != '>')
+    {
+        char c = html[end];
+        if (c == '"' || c == '\'')
+        {
+            // A quote only opens a value when it follows an '='
+            size_t previous = end;
+            while (previous > name_end && is_space(html[previous - 1]))
+            {
+                previous--;
+            }
+
+            if (previous > name_end && html[previous - 1] == '=')
+            {
+                size_t quote_end = this->find_next(c);
+                if (quote_end == std::string_view::npos)
+                {
+                    // An unterminated value: fall back to the first '>' after it
+                    end = this->find(end + 1, '>');
+                    break;
+                }
+            }
+        }
+
+        end = this->next_delimiter();
+    }
+
+    if (end == std::string_view::npos)
+    {
+        // A tag cut off by the end of the document is left as text
+        return false;
+    }
+
+    token.name = html.substr(name_start, name_end - name_start);
+    token.text = html.substr(start, end - start + 1);
+    token.start = start;
+    token.end = end;
+    this->pos = end + 1;
+
+    if (closing)
+    {
+        token.type = HtmlTokenType::CLOSE_TOKEN;
+    }
+    else if (html[end - 1] == '/')
+    {
+        token.type = HtmlTokenType::SELF_CLOSING_TOKEN;
+    }
+    else
+    {
+        token.type = HtmlTokenType::OPEN_TOKEN;
+
+        if (equals_ignore_case(token.name, "script") || equals_ignore_case(token.name, "style"))
+        {
+            this->raw_text_tag = token.name;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Reads the raw text of a <script> or <style> element, up to its closing tag.
+ *
+ * The closing tag itself is returned by the following call to `next`.
+ */
+bool HtmlTokenizer::read_raw_text(HtmlToken& token)
+{
+    std::string_view name = this->raw_text_tag;
+    this->raw_text_tag = std::string_view();
+
+    size_t search = this->pos;
+    size_t end = this->html.size();
+
+    while (true)
+    {
+        size_t candidate = this->find(search, '<');
+        if (candidate == std::string_view::npos)
+        {
+            break;
+        }
+        if (candidate + 1 >= this->html.size() || this->html[candidate + 1] != '/')
+        {
+            search = candidate + 1;
+            continue;
+        }
+
+        size_t after = candidate + 2 + name.size();
+        if (after <= this->html.size() && equals_ignore_case(this->html.substr(candidate + 2, name.size()), name) &&
+            (after == this->html.size() || is_space(this->html[after]) || this->html[after] == '>' || this->html[after] == '/'))
+        {
+            end = candidate;
+            break;
+        }
+
+        search = candidate + 2;
+    }
+
+    if (end == this->pos)
+    {
+        // An empty element: go straight on to its closing tag
+        return this->next(token);
+    }
+
+    this->read_text(token, end);
+    return true;
+}
@@ -0,0 +1,217 @@
+#include <HttpCache.hpp>
+#include <Utilities.hpp>
+#include <Logger.hpp>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <thread>
+
+
+/**
+ * @brief Constructs a new HttpCache object.
+ *
+ * The cache directory is created if it does not already exist. Entries written by earlier
+ * runs in the same directory are reused.
+ *
+ * @param directory The directory to keep cache entries in.
+ */
+HttpCache::HttpCache(const char* directory)
+{
+    this->directory = directory;
+
+    std::error_code error;
+    std::filesystem::create_directories(this->directory, error);
+    if (error)
+    {
+        LOG("Failed to create cache directory: ", this->directory);
+    }
+}
+
+/**
+ * @brief Destructor for the HttpCache class.
+ */
+HttpCache::~HttpCache()
+{
+}
+
+/**
+ * @brief Builds the path of an entry's file.
+ *
+ * @param normalized_url The normalized URL of the entry.
+ * @return std::string The path of the entry's `.entry` file.
+ */
+std::string HttpCache::path_for(const std::string& normalized_url)
+{
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash_string(normalized_url)));
+
+    return this->directory + "/" + name + ".entry";
+}
+
+/**
+ * @brief Reads the header lines of an entry, leaving the stream at the start of the body.
+ *
+ * @param entry The open entry file, positioned at its start.
+ * @param normalized_url The normalized URL the entry is expected to hold.
+ * @param validators Receives the validators of the entry.
+ * @return true if the header was read and belongs to the URL, false otherwise.
+ */
+static bool read_header(std::ifstream& entry, const std::string& normalized_url, CacheValidators& validators)
+{
+    std::string stored_url;
+    std::getline(entry, stored_url);
+
+    // Two URLs whose hashes collide share a file; the stored URL tells them apart
+    if (!entry || stored_url != normalized_url)
+    {
+        return false;
+    }
+
+    std::getline(entry, validators.etag);
+    std::getline(entry, validators.last_modified);
+
+    return static_cast<bool>(entry);
+}
+
+/**
+ * @brief Looks up the validators of a cached response.
+ *
+ * Only the header lines at the start of the entry are read.
+ *
+ * @param url The URL of the response.
+ * @param validators Receives the validators of the cached response.
+ * @return true if the URL is cached, false otherwise.
+ */
+bool HttpCache::lookup(const std::string& url, CacheValidators& validators)
+{
+    std::string normalized_url = normalize_url(url);
+
+    std::ifstream entry(this->path_for(normalized_url), std::ios::binary);
+    if (!entry.is_open() || !read_header(entry, normalized_url, validators))
+    {
+        return false;
+    }
+
+    return !validators.etag.empty() || !validators.last_modified.empty();
+}
+
+/**
+ * @brief Loads the body of a cached response, if it is the version a 304 confirmed.
+ *
+ * The body is read in one pass into a buffer sized from the file up front. If the entry was
+ * replaced since `lookup`, its validators no longer match those sent with the request, and
+ * it is treated as lost rather than served for a response the server never confirmed.
+ *
+ * @param url The URL of the response.
+ * @param expected The validators sent with the conditional request.
+ * @return std::string* The cached body, or nullptr if it cannot be read. The caller owns the string.
+ */
+std::string* HttpCache::load(const std::string& url, const CacheValidators& expected)
+{
+    std::string normalized_url = normalize_url(url);
+    std::string path = this->path_for(normalized_url);
+
+    std::ifstream entry(path, std::ios::binary | std::ios::ate);
+    if (!entry.is_open())
+    {
+        LOG("Failed to open cached entry: ", path);
+        return nullptr;
+    }
+
+    std::streamsize size = entry.tellg();
+    if (size < 0)
+    {
+        LOG("Failed to size cached entry: ", path);
+        return nullptr;
+    }
+    entry.seekg(0, std::ios::beg);
+
+    CacheValidators validators;
+    if (!read_header(entry, normalized_url, validators) ||
+        validators.etag != expected.etag || validators.last_modified != expected.last_modified)
+    {
+        LOG("Cached entry replaced since it was revalidated: ", path);
+        return nullptr;
+    }
+
+    std::streamsize body_size = size - static_cast<std::streamsize>(entry.tellg());
+    if (body_size < 0)
+    {
+        LOG("Failed to size cached body: ", path);
+        return nullptr;
+    }
+
+    std::string* content = new std::string(static_cast<size_t>(body_size), '\0');
+    if (body_size > 0 && !entry.read(&(*content)[0], body_size))
+    {
+        LOG("Failed to read cached body: ", path);
+        delete content;
+        return nullptr;
+    }
+
+    return content;
+}
+
+/**
+ * @brief Builds a suffix for temporary files that no other writer uses.
+ *
+ * Several threads, or several processes sharing the directory, may store the same URL at
+ * once. Each write gets its own temporary file from a per-process random token, the thread
+ * and a counter, so their bytes never interleave in one file.
+ */
+static std::string temporary_suffix()
+{
+    static const unsigned long long process_token = (static_cast<unsigned long long>(std::random_device{}()) << 32) | std::random_device{}();
+    static std::atomic<unsigned long long> counter{0};
+
+    char suffix[64];
+    std::snprintf(suffix, sizeof(suffix), ".%016llx.%zx.%llu.tmp", process_token,
+        std::hash<std::thread::id>()(std::this_thread::get_id()), counter.fetch_add(1));
+    return suffix;
+}
+
+/**
+ * @brief Stores a response body and its validators.
+ *
+ * The validators and the body go into one file, written under a temporary name unique to this
+ * write and renamed into place in a single step. A reader therefore always sees one complete
+ * version of the entry, whether a crash interrupts the write or several writers store the
+ * same URL at once.
+ *
+ * @param url The URL of the response.
+ * @param validators The validators the server sent with the response.
+ * @param body The response body.
+ * @return true if the entry was written, false otherwise.
+ */
+bool HttpCache::store(const std::string& url, const CacheValidators& validators, const std::string& body)
+{
+    std::string normalized_url = normalize_url(url);
+    std::string path = this->path_for(normalized_url);
+    std::string temporary = path + temporary_suffix();
+
+    std::ofstream entry(temporary, std::ios::binary | std::ios::trunc);
+    entry << normalized_url << '\n' << validators.etag << '\n' << validators.last_modified << '\n';
+    entry.write(body.data(), static_cast<std::streamsize>(body.size()));
+    entry.close();
+
+    std::error_code error;
+    if (!entry)
+    {
+        LOG("Failed to write cache entry for: ", url);
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        LOG("Failed to commit cache entry for: ", url);
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,261 @@
+#include <ResponseCache.hpp>
+#include <Utilities.hpp>
+#include <Logger.hpp>
+
+
+/**
+ * @brief Constructs a new ResponseCache object.
+ *
+ * @param byte_budget The total number of bytes the cache may hold, or 0 to disable it.
+ * @param ttl_ms How long an entry stays valid after being stored, in milliseconds.
+ */
+ResponseCache::ResponseCache(size_t byte_budget, long long ttl_ms)
+{
+    this->byte_budget = byte_budget;
+    this->ttl_ms = ttl_ms;
+}
+
+/**
+ * @brief Destructor for the ResponseCache class.
+ */
+ResponseCache::~ResponseCache()
+{
+}
+
+/**
+ * @brief Changes the byte budget and time to live of the cache.
+ *
+ * Shrinking the budget evicts entries straight away. The new time to live applies to
+ * entries stored from now on.
+ *
+ * @param byte_budget The total number of bytes the cache may hold, or 0 to disable it.
+ * @param ttl_ms How long an entry stays valid after being stored, in milliseconds.
+ */
+void ResponseCache::configure(size_t byte_budget, long long ttl_ms)
+{
+    this->byte_budget = byte_budget;
+    this->ttl_ms = ttl_ms;
+    this->trim();
+}
+
+/**
+ * @brief Checks whether the cache has a byte budget to hold pages in.
+ */
+bool ResponseCache::enabled()
+{
+    return this->byte_budget > 0;
+}
+
+/**
+ * @brief Looks up a page by URL.
+ *
+ * A hit moves the entry to the front of its shard's LRU list and stamps it with the next
+ * tick of the use clock, which orders entries across shards. Expired entries are removed
+ * and reported as a miss.
+ *
+ * @param url The URL of the page.
+ * @return std::shared_ptr<const CachedPage> The cached page, or nullptr on a miss.
+ */
+std::shared_ptr<const CachedPage> ResponseCache::lookup(const std::string& url)
+{
+    if (!this->enabled())
+    {
+        return nullptr;
+    }
+
+    std::string key = normalize_url(url);
+    Shard& shard = this->shard_for(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    auto found = shard.index.find(key);
+    if (found == shard.index.end())
+    {
+        return nullptr;
+    }
+
+    std::list<Entry>::iterator entry = found->second;
+    if (entry->expires_ms <= now_ms())
+    {
+        this->remove(shard, entry);
+        return nullptr;
+    }
+
+    entry->last_use = this->use_clock++;
+    shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+    return entry->page;
+}
+
+/**
+ * @brief Stores a page, replacing any entry for the same URL.
+ *
+ * Pages larger than the whole budget are not cached. If the cache then holds more than its
+ * budget, the least recently used entries are evicted until it fits again.
+ *
+ * @param url The URL of the page.
+ * @param page The page to store.
+ */
+void ResponseCache::store(const std::string& url, std::shared_ptr<const CachedPage> page)
+{
+    if (!this->enabled() || page == nullptr)
+    {
+        return;
+    }
+
+    std::string key = normalize_url(url);
+    size_t html_bytes = page->html != nullptr ? page->html->size() : 0;
+    size_t bytes = key.size() + html_bytes + page->markdown.size() + sizeof(Entry) + sizeof(CachedPage);
+
+    if (bytes > this->byte_budget)
+    {
+        LOG("Page too large to cache: ", url);
+        return;
+    }
+
+    {
+        Shard& shard = this->shard_for(key);
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        auto found = shard.index.find(key);
+        if (found != shard.index.end())
+        {
+            this->remove(shard, found->second);
+        }
+
+        shard.entries.push_front(Entry{ key, page, bytes, now_ms() + this->ttl_ms, this->use_clock++ });
+        shard.index[key] = shard.entries.begin();
+        this->total_bytes += bytes;
+    }
+
+    this->trim();
+}
+
+/**
+ * @brief Replaces the page of an existing entry, such as with its rendered markdown.
+ *
+ * The entry keeps its expiry time, so updating a page never extends how long its HTML is
+ * served. Nothing is replaced unless the entry is still live and holds the same HTML, so a
+ * page rendered from HTML that has since been refetched is dropped.
+ *
+ * @param url The URL of the page.
+ * @param page The page to store in place of the cached one.
+ * @return true if the entry was updated, false if it was missing, expired or refetched.
+ */
+bool ResponseCache::update(const std::string& url, std::shared_ptr<const CachedPage> page)
+{
+    if (!this->enabled() || page == nullptr)
+    {
+        return false;
+    }
+
+    std::string key = normalize_url(url);
+    size_t html_bytes = page->html != nullptr ? page->html->size() : 0;
+    size_t bytes = key.size() + html_bytes + page->markdown.size() + sizeof(Entry) + sizeof(CachedPage);
+
+    {
+        Shard& shard = this->shard_for(key);
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        auto found = shard.index.find(key);
+        if (found == shard.index.end())
+        {
+            return false;
+        }
+
+        std::list<Entry>::iterator entry = found->second;
+        if (entry->expires_ms <= now_ms() || entry->page->html != page->html)
+        {
+            return false;
+        }
+
+        this->total_bytes += bytes;
+        this->total_bytes -= entry->bytes;
+        entry->page = page;
+        entry->bytes = bytes;
+    }
+
+    this->trim();
+    return true;
+}
+
+/**
+ * @brief Removes every entry from the cache.
+ */
+void ResponseCache::clear()
+{
+    for (Shard& shard : this->shards)
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        while (!shard.entries.empty())
+        {
+            this->remove(shard, std::prev(shard.entries.end()));
+        }
+    }
+}
+
+/**
+ * @brief Returns the number of bytes currently held across all shards.
+ */
+size_t ResponseCache::size_bytes()
+{
+    return this->total_bytes;
+}
+
+/**
+ * @brief Picks the shard responsible for a key.
+ */
+ResponseCache::Shard& ResponseCache::shard_for(const std::string& key)
+{
+    return this->shards[hash_string(key) % SHARD_COUNT];
+}
+
+/**
+ * @brief Removes an entry from a shard and from the total byte count.
+ *
+ * The caller must hold the shard's lock.
+ */
+void ResponseCache::remove(Shard& shard, std::list<Entry>::iterator entry)
+{
+    this->total_bytes -= entry->bytes;
+    shard.index.erase(entry->url);
+    shard.entries.erase(entry);
+}
+
+/**
+ * @brief Evicts entries until the cache holds at most its byte budget.
+ *
+ * Each shard's LRU list ends with its least recently used entry, so the oldest entry in the
+ * cache is the tail with the lowest use stamp. The tails are compared one shard lock at a
+ * time, so no two are ever held at once. A tail used or evicted by another thread before its
+ * shard is locked again is left alone, and the next round looks again. Must be called without
+ * holding any shard lock.
+ */
+void ResponseCache::trim()
+{
+    while (this->total_bytes > this->byte_budget)
+    {
+        Shard* oldest = nullptr;
+        unsigned long long oldest_use = 0;
+
+        for (Shard& shard : this->shards)
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+
+            if (!shard.entries.empty() && (oldest == nullptr || shard.entries.back().last_use < oldest_use))
+            {
+                oldest = &shard;
+                oldest_use = shard.entries.back().last_use;
+            }
+        }
+
+        if (oldest == nullptr)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(oldest->lock);
+        if (!oldest->entries.empty() && oldest->entries.back().last_use == oldest_use)
+        {
+            this->remove(*oldest, std::prev(oldest->entries.end()));
+        }
+    }
+}
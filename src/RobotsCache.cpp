@@ -0,0 +1,504 @@
+#include <RobotsCache.hpp>
+#include <Utilities.hpp>
+#include <Logger.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+
+/**
+ * @brief How long a host stays blocked after its robots.txt could not be fetched.
+ */
+static const long long ERROR_TTL_MS = 10 * 60 * 1000;
+
+/**
+ * @brief How many redirects to follow to robots.txt, the minimum RFC 9309 asks for.
+ */
+static const long MAX_ROBOTS_REDIRECTS = 5;
+
+/**
+ * @brief Strips leading and trailing spaces, tabs and carriage returns.
+ */
+static std::string trim(const std::string& value)
+{
+    size_t start = value.find_first_not_of(" \t\r");
+    if (start == std::string::npos)
+    {
+        return "";
+    }
+
+    size_t end = value.find_last_not_of(" \t\r");
+    return value.substr(start, end - start + 1);
+}
+
+/**
+ * @brief Returns the product token a user agent starts with, such as "WebCrawler" for "WebCrawler/1.0".
+ *
+ * RFC 9309 limits product tokens to letters, underscores and hyphens, so anything from the
+ * first other character on, such as a version, is dropped.
+ */
+static std::string product_token(const std::string& agent)
+{
+    size_t end = 0;
+    while (end < agent.size() && ((agent[end] >= 'a' && agent[end] <= 'z') || (agent[end] >= 'A' && agent[end] <= 'Z') ||
+        agent[end] == '_' || agent[end] == '-'))
+    {
+        end++;
+    }
+
+    return agent.substr(0, end);
+}
+
+
+/**
+ * @brief Constructs an empty RobotsRules object, which allows every path.
+ */
+RobotsRules::RobotsRules()
+{
+    this->crawl_delay = 0;
+    this->disallow_all = false;
+    this->trie.push_back(TrieNode());
+}
+
+/**
+ * @brief Destructor for the RobotsRules class.
+ */
+RobotsRules::~RobotsRules()
+{
+}
+
+/**
+ * @brief Parses a robots.txt file and compiles the rules that apply to a user agent.
+ *
+ * The groups naming the user agent are used if there are any, otherwise those for `*`.
+ * A group matches when its User-agent line names the crawler's product token exactly, ignoring
+ * case and any version after it, so "WebCrawler" matches "webcrawler/2.1" but not "Web".
+ *
+ * @param robots_txt The contents of the robots.txt file.
+ * @param user_agent The product token of the crawler, such as "WebCrawler".
+ */
+void RobotsRules::parse(const std::string& robots_txt, const std::string& user_agent)
+{
+    std::string agent = product_token(user_agent);
+    to_lower_ascii(agent);
+
+    std::vector<std::pair<std::string, bool>> agent_rules;
+    std::vector<std::pair<std::string, bool>> star_rules;
+    double agent_delay = 0;
+    double star_delay = 0;
+    bool agent_found = false;
+
+    bool reading_agents = false;
+    bool group_for_agent = false;
+    bool group_for_star = false;
+
+    std::istringstream lines(robots_txt);
+    std::string line;
+
+    while (std::getline(lines, line))
+    {
+        line = line.substr(0, line.find('#'));
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+        {
+            continue;
+        }
+
+        std::string field = trim(line.substr(0, colon));
+        std::string value = trim(line.substr(colon + 1));
+        to_lower_ascii(field);
+
+        if (field == "user-agent")
+        {
+            // Consecutive User-agent lines open one group together
+            if (!reading_agents)
+            {
+                reading_agents = true;
+                group_for_agent = false;
+                group_for_star = false;
+            }
+
+            to_lower_ascii(value);
+            if (value == "*")
+            {
+                group_for_star = true;
+            }
+            else if (!agent.empty() && product_token(value) == agent)
+            {
+                group_for_agent = true;
+                agent_found = true;
+            }
+            continue;
+        }
+
+        reading_agents = false;
+
+        if (field == "allow" || field == "disallow")
+        {
+            // An empty rule matches nothing
+            if (value.empty())
+            {
+                continue;
+            }
+
+            std::pair<std::string, bool> rule(value, field == "allow");
+            if (group_for_agent)
+            {
+                agent_rules.push_back(rule);
+            }
+            else if (group_for_star)
+            {
+                star_rules.push_back(rule);
+            }
+        }
+        else if (field == "crawl-delay")
+        {
+            double delay = std::atof(value.c_str());
+            if (group_for_agent)
+            {
+                agent_delay = delay;
+            }
+            else if (group_for_star)
+            {
+                star_delay = delay;
+            }
+        }
+    }
+
+    for (const std::pair<std::string, bool>& rule : agent_found ? agent_rules : star_rules)
+    {
+        this->add_rule(rule.first, rule.second);
+    }
+
+    this->crawl_delay = agent_found ? agent_delay : star_delay;
+}
+
+/**
+ * @brief Adds a single Allow or Disallow rule.
+ *
+ * @param pattern The path pattern of the rule, which may use `*` and a trailing `$`.
+ * @param allow Whether the rule is an Allow rule.
+ */
+void RobotsRules::add_rule(const std::string& pattern, bool allow)
+{
+    if (pattern.find('*') != std::string::npos || pattern.back() == '$')
+    {
+        WildcardRule rule;
+        rule.pattern = pattern;
+        rule.allow = allow;
+
+        // Longest first, so matching can stop at the first rule shorter than the best match
+        auto position = std::upper_bound(this->wildcards.begin(), this->wildcards.end(), rule,
+            [](const WildcardRule& a, const WildcardRule& b) { return a.pattern.size() > b.pattern.size(); });
+        this->wildcards.insert(position, rule);
+        return;
+    }
+
+    int node = 0;
+    for (char c : pattern)
+    {
+        int next = -1;
+        for (const std::pair<char, int>& child : this->trie[node].children)
+        {
+            if (child.first == c)
+            {
+                next = child.second;
+                break;
+            }
+        }
+
+        if (next == -1)
+        {
+            next = static_cast<int>(this->trie.size());
+            this->trie[node].children.push_back(std::make_pair(c, next));
+            this->trie.push_back(TrieNode());
+        }
+
+        node = next;
+    }
+
+    TrieNode& end = this->trie[node];
+    end.allow = end.rule_length == -1 ? allow : (end.allow || allow);
+    end.rule_length = static_cast<int>(pattern.size());
+}
+
+/**
+ * @brief Checks whether the rules allow a path to be crawled.
+ *
+ * @param path The path and query of the URL, starting with "/".
+ * @return true if the path may be crawled, false otherwise.
+ */
+bool RobotsRules::allowed(const std::string& path) const
+{
+    if (this->disallow_all)
+    {
+        return false;
+    }
+
+    int best_length = -1;
+    bool best_allow = true;
+
+    // The deepest rule on the walk is the longest literal match
+    int node = 0;
+    for (char c : path)
+    {
+        int next = -1;
+        for (const std::pair<char, int>& child : this->trie[node].children)
+        {
+            if (child.first == c)
+            {
+                next = child.second;
+                break;
+            }
+        }
+
+        if (next == -1)
+        {
+            break;
+        }
+
+        node = next;
+        if (this->trie[node].rule_length != -1)
+        {
+            best_length = this->trie[node].rule_length;
+            best_allow = this->trie[node].allow;
+        }
+    }
+
+    const char* path_start = path.data();
+    const char* path_end = path_start + path.size();
+
+    for (const WildcardRule& rule : this->wildcards)
+    {
+        int length = static_cast<int>(rule.pattern.size());
+        if (length < best_length)
+        {
+            break;
+        }
+
+        const char* pattern_start = rule.pattern.data();
+        if (!match_wildcard(pattern_start, pattern_start + rule.pattern.size(), path_start, path_end))
+        {
+            continue;
+        }
+
+        if (length > best_length)
+        {
+            best_length = length;
+            best_allow = rule.allow;
+        }
+        else
+        {
+            best_allow = best_allow || rule.allow;
+        }
+    }
+
+    return best_length == -1 || best_allow;
+}
+
+/**
+ * @brief Matches a path against a rule using `*` wildcards and an optional trailing `$`.
+ *
+ * Without a trailing `$` the rule only has to match a prefix of the path.
+ */
+bool RobotsRules::match_wildcard(const char* pattern, const char* pattern_end, const char* path, const char* path_end)
+{
+    bool anchored = pattern_end > pattern && *(pattern_end - 1) == '$';
+    if (anchored)
+    {
+        pattern_end--;
+    }
+
+    const char* star_pattern = nullptr;
+    const char* star_path = nullptr;
+
+    while (true)
+    {
+        if (pattern == pattern_end)
+        {
+            if (!anchored || path == path_end)
+            {
+                return true;
+            }
+        }
+        else if (*pattern == '*')
+        {
+            star_pattern = ++pattern;
+            star_path = path;
+            continue;
+        }
+        else if (path != path_end && *pattern == *path)
+        {
+            pattern++;
+            path++;
+            continue;
+        }
+
+        // Let the last `*` swallow one more character and try again
+        if (star_pattern == nullptr || star_path == path_end)
+        {
+            return false;
+        }
+
+        pattern = star_pattern;
+        path = ++star_path;
+    }
+}
+
+
+/**
+ * @brief Constructs a new RobotsCache object.
+ *
+ * @param manager The CurlManager used to fetch robots.txt and to apply Crawl-delay.
+ * @param user_agent The product token of the crawler, used to pick groups in robots.txt.
+ * @param ttl_ms How long the rules of a host are kept before robots.txt is fetched again.
+ */
+RobotsCache::RobotsCache(CurlManager* manager, const char* user_agent, long long ttl_ms)
+{
+    this->manager = manager;
+    this->user_agent = user_agent;
+    this->ttl_ms = ttl_ms;
+}
+
+/**
+ * @brief Destructor for the RobotsCache class.
+ */
+RobotsCache::~RobotsCache()
+{
+}
+
+/**
+ * @brief Checks whether a URL may be crawled according to its host's robots.txt.
+ *
+ * @param url The URL to check.
+ * @return true if the URL may be crawled, false otherwise.
+ */
+bool RobotsCache::allowed(const std::string& url)
+{
+    return this->rules_for(url)->allowed(url_path(url));
+}
+
+/**
+ * @brief Returns the compiled rules of a URL's host, fetching robots.txt if needed.
+ *
+ * Lookups are safe from several threads. robots.txt is fetched with a blocking request
+ * outside the lock, by the first thread to need it. Other threads checking the same host in
+ * the meantime keep using its expired rules if there are any, and otherwise wait for that
+ * fetch instead of starting their own. A Crawl-delay is forwarded to the manager's per-host
+ * scheduler. That scheduler is not thread-safe, so with transfers driven by `poll`, check URLs
+ * from the thread that drives them.
+ *
+ * @param url Any URL on the host.
+ * @return std::shared_ptr<const RobotsRules> The rules of the host.
+ */
+std::shared_ptr<const RobotsRules> RobotsCache::rules_for(const std::string& url)
+{
+    std::string host = url_host(url);
+    std::shared_future<std::shared_ptr<const RobotsRules>> pending;
+    std::promise<std::shared_ptr<const RobotsRules>> fetched;
+
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+
+        auto found = this->hosts.find(host);
+        if (found != this->hosts.end() && found->second.expires_ms > now_ms())
+        {
+            return found->second.rules;
+        }
+
+        auto in_flight = this->fetching.find(host);
+        if (in_flight == this->fetching.end())
+        {
+            this->fetching[host] = fetched.get_future().share();
+        }
+        else if (found != this->hosts.end())
+        {
+            return found->second.rules;
+        }
+        else
+        {
+            pending = in_flight->second;
+        }
+    }
+
+    if (pending.valid())
+    {
+        return pending.get();
+    }
+
+    std::shared_ptr<const RobotsRules> rules = this->fetch_rules(url, host);
+    fetched.set_value(rules);
+    return rules;
+}
+
+/**
+ * @brief Fetches and compiles robots.txt for a host and stores it in the cache.
+ *
+ * Following RFC 9309, up to five redirects are followed and the file is accepted whatever its
+ * Content-Type or size. A missing robots.txt (4xx), or one behind more redirects, allows
+ * everything, while a server or network error disallows everything until a shorter retry
+ * interval has passed.
+ *
+ * The host's request rate follows the Crawl-delay, and is reset when a refreshed robots.txt
+ * drops it. The caller must have registered the fetch in `fetching`, which is cleared once
+ * the rules are stored.
+ */
+std::shared_ptr<const RobotsRules> RobotsCache::fetch_rules(const std::string& url, const std::string& host)
+{
+    std::string robots_url = url_origin(url) + "/robots.txt";
+    LOG("Fetching robots.txt: ", robots_url);
+
+    // Only this thread replaces the host's entry, so its previous delay cannot change meanwhile
+    double previous_delay = 0;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+
+        auto found = this->hosts.find(host);
+        if (found != this->hosts.end())
+        {
+            previous_delay = found->second.rules->crawl_delay;
+        }
+    }
+
+    FetchResult result = this->manager->fetch_unfiltered(robots_url.c_str(), MAX_ROBOTS_REDIRECTS);
+
+    std::shared_ptr<RobotsRules> rules = std::make_shared<RobotsRules>();
+    long long ttl_ms = this->ttl_ms;
+
+    if (result.code == CURLE_TOO_MANY_REDIRECTS)
+    {
+        LOG("robots.txt redirected too often, treating it as missing: ", host);
+    }
+    else if (result.code != CURLE_OK || result.status >= 500)
+    {
+        LOG("robots.txt unavailable, disallowing host: ", host);
+        rules->disallow_all = true;
+        ttl_ms = std::min(ttl_ms, ERROR_TTL_MS);
+    }
+    else if (result.status >= 200 && result.status < 300 && result.html_content != nullptr)
+    {
+        rules->parse(*result.html_content, this->user_agent);
+    }
+
+    delete result.html_content;
+
+    if (rules->crawl_delay > 0)
+    {
+        this->manager->set_host_rate(host, 1.0 / rules->crawl_delay, 1);
+    }
+    else if (previous_delay > 0)
+    {
+        // The refreshed robots.txt no longer asks for a delay
+        this->manager->reset_host_rate(host);
+    }
+
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    Entry& entry = this->hosts[host];
+    entry.rules = rules;
+    entry.expires_ms = now_ms() + ttl_ms;
+    this->fetching.erase(host);
+
+    return rules;
+}
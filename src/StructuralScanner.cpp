@@ -0,0 +1,370 @@
+#include <StructuralScanner.hpp>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__)) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STRUCTURAL_SSE2 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define STRUCTURAL_AVX2 1
+#define AVX2_TARGET
+#elif defined(__GNUC__) || defined(__clang__)
+#define STRUCTURAL_AVX2 1
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+
+/**
+ * @brief Classifies a block one byte at a time.
+ */
+static void classify_block_scalar(const char* block, StructuralBlock& out, unsigned tracked)
+{
+    std::memset(&out, 0, sizeof(out));
+
+    for (size_t i = 0; i < StructuralScanner::BLOCK_SIZE; i++)
+    {
+        uint64_t bit = 1ULL << i;
+
+        switch (block[i])
+        {
+            case '<': out.bits[LESS_THAN] |= bit; break;
+            case '>': out.bits[GREATER_THAN] |= bit; break;
+            case '&': out.bits[AMPERSAND] |= bit; break;
+            case '"': out.bits[DOUBLE_QUOTE] |= bit; break;
+            case '\'': out.bits[SINGLE_QUOTE] |= bit; break;
+            case '\n': out.bits[NEWLINE] |= bit; out.bits[WHITESPACE] |= bit; break;
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\f': out.bits[WHITESPACE] |= bit; break;
+            default: break;
+        }
+    }
+
+    for (int kind = 0; kind < STRUCTURAL_KIND_COUNT; kind++)
+    {
+        if ((tracked & (1u << kind)) == 0)
+        {
+            out.bits[kind] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Classifies consecutive whole blocks one byte at a time.
+ */
+static void classify_scalar(const char* data, size_t blocks, StructuralBlock* out, unsigned tracked)
+{
+    for (size_t i = 0; i < blocks; i++)
+    {
+        classify_block_scalar(data + i * StructuralScanner::BLOCK_SIZE, out[i], tracked);
+    }
+}
+
+#ifdef STRUCTURAL_SSE2
+/**
+ * @brief Returns the bitmap of the bytes of a 64-byte block equal to `character`.
+ */
+static inline uint64_t equal_sse2(const __m128i (&chunks)[4], __m128i character)
+{
+    uint64_t bits = 0;
+    for (int chunk = 0; chunk < 4; chunk++)
+    {
+        uint64_t chunk_bits = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunks[chunk], character)));
+        bits |= chunk_bits << (chunk * 16);
+    }
+    return bits;
+}
+
+/**
+ * @brief Classifies a block as four 16-byte vectors.
+ */
+static inline void classify_block_sse2(const char* block, StructuralBlock& out, unsigned tracked)
+{
+    __m128i chunks[4];
+    for (int chunk = 0; chunk < 4; chunk++)
+    {
+        chunks[chunk] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + chunk * 16));
+    }
+
+    out.bits[LESS_THAN] = tracked & structural_mask(LESS_THAN) ? equal_sse2(chunks, _mm_set1_epi8('<')) : 0;
+    out.bits[GREATER_THAN] = tracked & structural_mask(GREATER_THAN) ? equal_sse2(chunks, _mm_set1_epi8('>')) : 0;
+    out.bits[AMPERSAND] = tracked & structural_mask(AMPERSAND) ? equal_sse2(chunks, _mm_set1_epi8('&')) : 0;
+    out.bits[DOUBLE_QUOTE] = tracked & structural_mask(DOUBLE_QUOTE) ? equal_sse2(chunks, _mm_set1_epi8('"')) : 0;
+    out.bits[SINGLE_QUOTE] = tracked & structural_mask(SINGLE_QUOTE) ? equal_sse2(chunks, _mm_set1_epi8('\'')) : 0;
+    out.bits[NEWLINE] = tracked & (structural_mask(NEWLINE) | structural_mask(WHITESPACE)) ? equal_sse2(chunks, _mm_set1_epi8('\n')) : 0;
+    out.bits[WHITESPACE] = tracked & structural_mask(WHITESPACE) ? out.bits[NEWLINE] |
+        equal_sse2(chunks, _mm_set1_epi8(' ')) |
+        equal_sse2(chunks, _mm_set1_epi8('\t')) |
+        equal_sse2(chunks, _mm_set1_epi8('\r')) |
+        equal_sse2(chunks, _mm_set1_epi8('\f')) : 0;
+
+    if ((tracked & structural_mask(NEWLINE)) == 0)
+    {
+        out.bits[NEWLINE] = 0;
+    }
+}
+
+/**
+ * @brief Classifies consecutive whole blocks with SSE2.
+ */
+static void classify_sse2(const char* data, size_t blocks, StructuralBlock* out, unsigned tracked)
+{
+    for (size_t i = 0; i < blocks; i++)
+    {
+        classify_block_sse2(data + i * StructuralScanner::BLOCK_SIZE, out[i], tracked);
+    }
+}
+#endif
+
+#ifdef STRUCTURAL_AVX2
+/**
+ * @brief Returns the bitmap of the bytes of a 64-byte block equal to `character`.
+ */
+AVX2_TARGET static inline uint64_t equal_avx2(const __m256i& low, const __m256i& high, const __m256i& character)
+{
+    uint32_t low_bits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, character)));
+    uint32_t high_bits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, character)));
+    return static_cast<uint64_t>(low_bits) | (static_cast<uint64_t>(high_bits) << 32);
+}
+
+/**
+ * @brief Classifies a block as two 32-byte vectors.
+ */
+AVX2_TARGET static inline void classify_block_avx2(const char* block, StructuralBlock& out, unsigned tracked)
+{
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+
+    out.bits[LESS_THAN] = tracked & structural_mask(LESS_THAN) ? equal_avx2(low, high, _mm256_set1_epi8('<')) : 0;
+    out.bits[GREATER_THAN] = tracked & structural_mask(GREATER_THAN) ? equal_avx2(low, high, _mm256_set1_epi8('>')) : 0;
+    out.bits[AMPERSAND] = tracked & structural_mask(AMPERSAND) ? equal_avx2(low, high, _mm256_set1_epi8('&')) : 0;
+    out.bits[DOUBLE_QUOTE] = tracked & structural_mask(DOUBLE_QUOTE) ? equal_avx2(low, high, _mm256_set1_epi8('"')) : 0;
+    out.bits[SINGLE_QUOTE] = tracked & structural_mask(SINGLE_QUOTE) ? equal_avx2(low, high, _mm256_set1_epi8('\'')) : 0;
+    out.bits[NEWLINE] = tracked & (structural_mask(NEWLINE) | structural_mask(WHITESPACE)) ? equal_avx2(low, high, _mm256_set1_epi8('\n')) : 0;
+    out.bits[WHITESPACE] = tracked & structural_mask(WHITESPACE) ? out.bits[NEWLINE] |
+        equal_avx2(low, high, _mm256_set1_epi8(' ')) |
+        equal_avx2(low, high, _mm256_set1_epi8('\t')) |
+        equal_avx2(low, high, _mm256_set1_epi8('\r')) |
+        equal_avx2(low, high, _mm256_set1_epi8('\f')) : 0;
+
+    if ((tracked & structural_mask(NEWLINE)) == 0)
+    {
+        out.bits[NEWLINE] = 0;
+    }
+}
+
+/**
+ * @brief Classifies consecutive whole blocks with AVX2.
+ */
+AVX2_TARGET static void classify_avx2(const char* data, size_t blocks, StructuralBlock* out, unsigned tracked)
+{
+    for (size_t i = 0; i < blocks; i++)
+    {
+        classify_block_avx2(data + i * StructuralScanner::BLOCK_SIZE, out[i], tracked);
+    }
+}
+
+/**
+ * @brief Checks whether the CPU and operating system support AVX2.
+ */
+static bool cpu_has_avx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    // AVX2 needs the OS to save the YMM registers (OSXSAVE, and XCR0 bits 1 and 2)
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+/**
+ * @brief Returns the fastest kernel the CPU supports.
+ */
+static ScanKernel detect_kernel()
+{
+#ifdef STRUCTURAL_AVX2
+    if (cpu_has_avx2())
+    {
+        return ScanKernel::AVX2_KERNEL;
+    }
+#endif
+#ifdef STRUCTURAL_SSE2
+    return ScanKernel::SSE2_KERNEL;
+#else
+    return ScanKernel::SCALAR_KERNEL;
+#endif
+}
+
+/**
+ * @brief The kernel in use, detected when the library is loaded.
+ */
+static ScanKernel active_kernel = detect_kernel();
+
+
+/**
+ * @brief Constructs a new StructuralScanner object.
+ *
+ * @param text The text to search. It is not copied and must outlive the scanner.
+ * @param tracked The kinds to classify, as an OR of structural_mask values.
+ */
+StructuralScanner::StructuralScanner(std::string_view text, unsigned tracked)
+{
+    this->tracked = tracked;
+    this->reset(text);
+}
+
+/**
+ * @brief Destructor for the StructuralScanner class.
+ */
+StructuralScanner::~StructuralScanner()
+{
+}
+
+/**
+ * @brief Starts searching another text.
+ */
+void StructuralScanner::reset(std::string_view text)
+{
+    this->text = text;
+    this->window_start = 0;
+    this->window_end = 0;
+    this->cursor_block = 0;
+    this->cursor_bits = 0;
+
+    if (!text.empty())
+    {
+        this->seek(0);
+    }
+}
+
+/**
+ * @brief Classifies the window of blocks starting at `block_start`.
+ */
+void StructuralScanner::load(size_t block_start)
+{
+    this->window_start = block_start;
+    this->window_end = block_start + WINDOW_BLOCKS * BLOCK_SIZE;
+    classify(this->text.data() + block_start, this->text.size() - block_start, this->window, WINDOW_BLOCKS, this->tracked);
+
+    for (size_t i = 0; i < WINDOW_BLOCKS; i++)
+    {
+        uint64_t any = 0;
+        for (int kind = 0; kind < STRUCTURAL_KIND_COUNT; kind++)
+        {
+            any |= this->window[i].bits[kind];
+        }
+        this->window_any[i] = any;
+    }
+}
+
+/**
+ * @brief Runs the active kernel over whole blocks.
+ */
+static void classify_blocks(const char* data, size_t blocks, StructuralBlock* out, unsigned tracked)
+{
+    switch (active_kernel)
+    {
+#ifdef STRUCTURAL_AVX2
+        case ScanKernel::AVX2_KERNEL:
+            classify_avx2(data, blocks, out, tracked);
+            return;
+#endif
+#ifdef STRUCTURAL_SSE2
+        case ScanKernel::SSE2_KERNEL:
+            classify_sse2(data, blocks, out, tracked);
+            return;
+#endif
+        default:
+            classify_scalar(data, blocks, out, tracked);
+            return;
+    }
+}
+
+/**
+ * @brief Classifies consecutive 64-byte blocks with the active kernel.
+ *
+ * @param data The first byte of the first block.
+ * @param length The bytes available from `data`. A final partial block is padded with bytes
+ *               of no kind, and blocks past the end are left empty.
+ * @param out Receives the bitmaps of each block, empty for kinds that are not tracked.
+ * @param blocks The number of blocks to classify.
+ * @param tracked The kinds to classify, as an OR of structural_mask values.
+ */
+void StructuralScanner::classify(const char* data, size_t length, StructuralBlock* out, size_t blocks, unsigned tracked)
+{
+    size_t whole = length / BLOCK_SIZE < blocks ? length / BLOCK_SIZE : blocks;
+    classify_blocks(data, whole, out, tracked);
+
+    if (whole == blocks)
+    {
+        return;
+    }
+
+    size_t remaining = length - whole * BLOCK_SIZE;
+    if (remaining > 0)
+    {
+        char padded[BLOCK_SIZE];
+        std::memset(padded, 0, BLOCK_SIZE);
+        std::memcpy(padded, data + whole * BLOCK_SIZE, remaining);
+        classify_blocks(padded, 1, out + whole, tracked);
+        whole++;
+    }
+
+    std::memset(out + whole, 0, (blocks - whole) * sizeof(StructuralBlock));
+}
+/**
+ * @brief Returns the kernel in use.
+ */
+ScanKernel StructuralScanner::get_kernel()
+{
+    return active_kernel;
+}
+
+/**
+ * @brief Switches the kernel, for comparing them. Not thread-safe with running scans.
+ *
+ * @param kernel The kernel to use.
+ * @return true if the CPU supports it and it is now in use, false otherwise.
+ */
+bool StructuralScanner::set_kernel(ScanKernel kernel)
+{
+    ScanKernel best = detect_kernel();
+    if (kernel > best)
+    {
+        return false;
+    }
+
+    active_kernel = kernel;
+    return true;
+}
+
+/**
+ * @brief Returns the name of a kernel.
+ */
+const char* StructuralScanner::kernel_name(ScanKernel kernel)
+{
+    switch (kernel)
+    {
+        case ScanKernel::AVX2_KERNEL: return "avx2";
+        case ScanKernel::SSE2_KERNEL: return "sse2";
+        default: return "scalar";
+    }
+}
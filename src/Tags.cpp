@@ -1,20 +1,22 @@
 #include <Tags.hpp>
 #include <Logger.hpp>
+#include <cstdint>
 
 /**
- * @brief A constant unordered map that associates HTML tag names with their corresponding TagType enum values.
- * 
- * This map is used to convert string representations of HTML tags into their respective TagType enum values.
- * 
- * Example usage:
- * 
- * @code
- * TagType tagType = string_to_tag.at("div"); // tagType will be TagType::DIV
- * @endcode
- * 
+ * @struct TagName
+ * @brief A lower-case HTML tag name and its TagType.
+ */
+struct TagName
+{
+    const char* name;
+    TagType type;
+};
+
+/**
+ * @brief The tag names recognised by stringToTagType, in lower case.
  */
-const std::unordered_map<std::string, TagType> string_to_tag = {
-    {"!DOCTYPE", DOCTYPE},
+static constexpr TagName TAG_NAMES[] = {
+    {"!doctype", DOCTYPE},
     {"html", HTML},
     {"head", HEAD},
     {"title", TITLE},
@@ -58,6 +60,95 @@ const std::unordered_map<std::string, TagType> string_to_tag = {
     {"font", FONT}
 };
 
+/**
+ * @brief The longest tag name in TAG_NAMES, so every name fits in a 64-bit key.
+ */
+static constexpr size_t MAX_TAG_NAME = 8;
+
+/**
+ * @brief The multiplier of the tag name hash, chosen so the keys of TAG_NAMES never collide.
+ */
+static constexpr uint64_t TAG_HASH_MULTIPLIER = 0x5d45a6562a2adb29ULL;
+
+/**
+ * @brief The number of bits of the hash, giving a table of 128 slots.
+ */
+static constexpr int TAG_HASH_BITS = 7;
+
+/**
+ * @brief Packs a lower-case name of at most 8 bytes into an integer, one byte per position.
+ */
+static constexpr uint64_t tag_key(const char* name)
+{
+    uint64_t key = 0;
+    for (size_t i = 0; name[i] != '\0'; i++)
+    {
+        key |= static_cast<uint64_t>(static_cast<unsigned char>(name[i])) << (8 * i);
+    }
+    return key;
+}
+
+/**
+ * @brief Returns the slot of a key in the tag table (multiplicative hashing).
+ */
+static constexpr size_t tag_slot(uint64_t key)
+{
+    return static_cast<size_t>((key * TAG_HASH_MULTIPLIER) >> (64 - TAG_HASH_BITS));
+}
+
+/**
+ * @struct TagTable
+ * @brief The perfect hash table of TAG_NAMES. Empty slots have a key of 0, which no name packs to.
+ */
+struct TagTable
+{
+    uint64_t keys[1 << TAG_HASH_BITS];
+    TagType types[1 << TAG_HASH_BITS];
+};
+
+/**
+ * @brief Builds the tag table at compile time.
+ */
+static constexpr TagTable build_tag_table()
+{
+    TagTable table = {};
+    for (const TagName& tag : TAG_NAMES)
+    {
+        table.keys[tag_slot(tag_key(tag.name))] = tag_key(tag.name);
+        table.types[tag_slot(tag_key(tag.name))] = tag.type;
+    }
+    return table;
+}
+
+/**
+ * @brief Checks that every name of TAG_NAMES has a slot of its own and fits in a key.
+ */
+static constexpr bool tag_table_is_perfect()
+{
+    TagTable table = build_tag_table();
+    for (const TagName& tag : TAG_NAMES)
+    {
+        size_t length = 0;
+        while (tag.name[length] != '\0')
+        {
+            length++;
+        }
+
+        if (length == 0 || length > MAX_TAG_NAME || table.keys[tag_slot(tag_key(tag.name))] != tag_key(tag.name))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(tag_table_is_perfect(), "Tag names collide in the tag table, pick another TAG_HASH_MULTIPLIER");
+
+/**
+ * @brief The tag table, built once by the compiler.
+ */
+static constexpr TagTable TAG_TABLE = build_tag_table();
+
 /**
  * @brief A mapping from TagType enum values to their corresponding HTML tag strings.
  * 
@@ -136,23 +227,39 @@ std::string tagTypeToString(TagType tag){
 }
 
 /**
- * @brief Converts a string representation of a tag type to its corresponding TagType enum value.
+ * @brief Converts a tag name to its corresponding TagType enum value, ignoring case.
  *
- * This function attempts to find the TagType associated with the given string in the string_to_tag map.
- * If the string is not found in the map, it logs an error message and returns TagType::UNKNOWN.
+ * The name is packed into a 64-bit key, lower-casing ASCII letters on the way, and looked up
+ * in a perfect hash table built at compile time: one multiply, one load and one compare, with
+ * no allocation and no exceptions.
  *
- * @param tag_type The string representation of the tag type.
- * @return The corresponding TagType enum value, or TagType::UNKNOWN if the string is not found.
+ * @param tag_type The tag name, such as "div" or "DIV".
+ * @return The corresponding TagType enum value, or TagType::UNKNOWN if the name is not recognised.
  */
-TagType stringToTagType(std::string tag_type){
-    try{
-        return string_to_tag.at(tag_type);
+TagType stringToTagType(std::string_view tag_type){
+    if (tag_type.empty() || tag_type.size() > MAX_TAG_NAME){
+        return TagType::UNKNOWN;
     }
-    catch (std::out_of_range& e){
-        LOG("TagType not found in string_to_tag map");
+
+    uint64_t key = 0;
+    for (size_t i = 0; i < tag_type.size(); i++){
+        unsigned char c = static_cast<unsigned char>(tag_type[i]);
+        if (c == '\0'){
+            return TagType::UNKNOWN;
+        }
+        if (c >= 'A' && c <= 'Z'){
+            c |= 0x20;
+        }
+        key |= static_cast<uint64_t>(c) << (8 * i);
+    }
+
+    size_t slot = tag_slot(key);
+    if (TAG_TABLE.keys[slot] != key){
+        LOG("TagType not found in the tag table");
         return TagType::UNKNOWN;
     }
 
+    return TAG_TABLE.types[slot];
 }
 
 
@@ -194,7 +301,7 @@ SingleTag::~SingleTag()
  * @param end The ending index of the tag within the content.
  * @return TagOrganisation The type of tag organisation (OPENING, CLOSING, SELF_CLOSING).
  */
-TagOrganisation SingleTag::getTagOrganisation(std::string* content, int start, int end)
+TagOrganisation SingleTag::getTagOrganisation(const std::string* content, int start, int end)
 {
     if (content->at(start + 1) == '/')
     {
@@ -237,46 +344,134 @@ TagOrganisation SingleTag::getTagOrganisation(std::string* content, int start, i
 
 
 /**
- * @brief Constructs a new Tag object.
- * 
- * @param name The name of the tag, passed by reference.
+ * @brief Constructs an empty TagTree.
+ */
+TagTree::TagTree()
+{
+    this->root = NO_TAG;
+}
+
+/**
+ * @brief Destructor for the TagTree class.
+ */
+TagTree::~TagTree()
+{
+}
+
+/**
+ * @brief Adds an element for an opening tag, not yet closed or linked into the tree.
+ *
+ * @param name The type of the tag.
  * @param start_open The starting position of the opening tag.
  * @param start_close The ending position of the opening tag.
+ * @return uint32_t The index of the new element.
+ */
+uint32_t TagTree::add(TagType name, int start_open, int start_close)
+{
+    uint32_t tag = static_cast<uint32_t>(this->names.size());
+
+    this->names.push_back(static_cast<uint8_t>(name));
+    this->start_opens.push_back(start_open);
+    this->start_closes.push_back(start_close);
+    this->end_opens.push_back(-1);
+    this->end_closes.push_back(-1);
+    this->parents.push_back(NO_TAG);
+    this->first_children.push_back(NO_TAG);
+    this->next_siblings.push_back(NO_TAG);
+
+    return tag;
+}
+
+/**
+ * @brief Records the position of an element's closing tag.
+ *
+ * @param tag The index of the element.
  * @param end_open The starting position of the closing tag.
  * @param end_close The ending position of the closing tag.
  */
-Tag::Tag(TagType& name, int start_open, int start_close, int end_open, int end_close)
+void TagTree::close(uint32_t tag, int end_open, int end_close)
 {
-    this->Name = new TagType(name);
-    this->start_open = new int(start_open);
-    this->start_close = new int(start_close);
-    this->end_open = new int(end_open);
-    this->end_close = new int(end_close);
+    this->end_opens[tag] = end_open;
+    this->end_closes[tag] = end_close;
 }
 
 /**
- * @brief Destructor for the Tag class.
+ * @brief Appends an element to the children of `parent`, or to the roots.
  *
- * This destructor is responsible for cleaning up the dynamically allocated
- * memory associated with the Tag object. It deletes the memory allocated for
- * the Name, start_open, start_close, end_open, and end_close members. It also
- * iterates through the Children vector and deletes each child Tag object before
- * clearing the vector.
+ * Children are kept as a singly linked list, so the caller passes the current last child to
+ * append after; the open-element stack of parseTagTree already tracks it.
+ *
+ * @param parent The index of the parent, or NO_TAG to make `child` a root.
+ * @param previous The last child of `parent` (or the last root), or NO_TAG if it has none yet.
+ * @param child The index of the element to append.
  */
-Tag::~Tag()
+void TagTree::link(uint32_t parent, uint32_t previous, uint32_t child)
 {
-    delete this->Name;
-    delete this->start_open;
-    delete this->start_close;
-    delete this->end_open;
-    delete this->end_close;
+    this->parents[child] = parent;
+    this->next_siblings[child] = NO_TAG;
 
-    for (Tag* child : this->Children)
+    if (previous != NO_TAG)
+    {
+        this->next_siblings[previous] = child;
+    }
+    else if (parent != NO_TAG)
+    {
+        this->first_children[parent] = child;
+    }
+    else
     {
-        delete child;
+        this->root = child;
     }
+}
+
+/**
+ * @brief Removes every element.
+ */
+void TagTree::clear()
+{
+    this->names.clear();
+    this->start_opens.clear();
+    this->start_closes.clear();
+    this->end_opens.clear();
+    this->end_closes.clear();
+    this->parents.clear();
+    this->first_children.clear();
+    this->next_siblings.clear();
+    this->root = NO_TAG;
+}
+
+/**
+ * @brief Returns the number of elements, including any left unlinked.
+ */
+size_t TagTree::size() const
+{
+    return this->names.size();
+}
+
+/**
+ * @brief Returns the bytes reserved by the arrays.
+ */
+size_t TagTree::memory_usage() const
+{
+    return this->names.capacity() * sizeof(uint8_t) +
+        (this->start_opens.capacity() + this->start_closes.capacity() + this->end_opens.capacity() + this->end_closes.capacity()) * sizeof(int32_t) +
+        (this->parents.capacity() + this->first_children.capacity() + this->next_siblings.capacity()) * sizeof(uint32_t);
+}
 
-    this->Children.clear();
+/**
+ * @brief Returns a handle to the element at `tag`.
+ */
+Tag TagTree::get(uint32_t tag) const
+{
+    return Tag(this, tag);
+}
+
+/**
+ * @brief Returns the first element with no parent; follow `next_sibling` for the others.
+ */
+Tag TagTree::first_root() const
+{
+    return Tag(this, this->root);
 }
 
 /**
@@ -289,7 +484,7 @@ Tag::~Tag()
  * @param content The input string containing the content to be sanitized.
  * @return A sanitized string with HTML-like tags removed.
  */
-std::string Tag::sanitizeContent(std::string& content){
+std::string Tag::sanitizeContent(const std::string& content) const{
     std::string sanitized_content = "";
 
     int pos = 0;
@@ -350,7 +545,7 @@ std::string Tag::sanitizeContent(std::string& content){
  * @param content The input string to be beautified.
  * @return A new string with the beautified content.
  */
-std::string Tag::beautify_content(std::string& content){
+std::string Tag::beautify_content(const std::string& content) const{
     std::string tabs_removed = "";
 
 
@@ -401,7 +596,7 @@ std::string Tag::beautify_content(std::string& content){
  * @brief Parses the content based on the tag type and returns the formatted string.
  * 
  * This function takes a reference to a string containing the content and formats it
- * according to the tag type specified in the `Name` member of the `Tag` class. The
+ * according to the tag type returned by the `Name` accessor of the `Tag`. The
  * formatting is done as follows:
  * - TagType::TITLE: Adds a single '#' prefix and a newline suffix.
  * - TagType::H1: Adds a '##' prefix.
@@ -419,8 +614,8 @@ std::string Tag::beautify_content(std::string& content){
  * @param content A reference to the string containing the content to be formatted.
  * @return A formatted string based on the tag type.
  */
-std::string Tag::parse_content(std::string& content){
-    switch (*this->Name)
+std::string Tag::parse_content(const std::string& content) const{
+    switch (this->Name())
     {
         case TagType::TITLE:
         {
@@ -484,30 +679,31 @@ std::string Tag::parse_content(std::string& content){
  * @param indent The indentation level for beautifying the content.
  * @return A string containing the processed content of the tag.
  */
-std::string Tag::getContent(std::string* html_content, int indent){
+std::string Tag::getContent(const std::string* html_content, int indent) const{
 
-    if (this->Children.empty())
+    Tag child = this->first_child();
+    if (!child)
     {        
         
-        return this->parse_content(beautify_content(sanitizeContent(html_content->substr(*this->start_close + 1, *this->end_open - *this->start_close - 1))));
+        return this->parse_content(beautify_content(sanitizeContent(html_content->substr(this->start_close() + 1, this->end_open() - this->start_close() - 1))));
     }
     
     std::string content = "";
-    Tag* last_child = this;
+    Tag last_child = *this;
 
-    for (Tag* child : this->Children){
+    for (; child; child = child.next_sibling()){
 
-        std::string direct_content = html_content->substr(*last_child->start_close + 1, *child->start_open - *last_child->start_close - 1);
+        std::string direct_content = html_content->substr(last_child.start_close() + 1, child.start_open() - last_child.start_close() - 1);
         direct_content = beautify_content(sanitizeContent(direct_content));
         content += direct_content;
 
-        std::string child_content = child->getContent(html_content, indent + 2);
+        std::string child_content = child.getContent(html_content, indent + 2);
         content += child_content;
         last_child = child;
 
     }
 
-    std::string direct_content = html_content->substr(*last_child->end_close + 1, *this->end_open - *last_child->end_close - 1);
+    std::string direct_content = html_content->substr(last_child.end_close() + 1, this->end_open() - last_child.end_close() - 1);
     direct_content = beautify_content(sanitizeContent(direct_content));
     content += direct_content;
 
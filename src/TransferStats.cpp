@@ -0,0 +1,247 @@
+#include <TransferStats.hpp>
+#include <algorithm>
+#include <cstdio>
+
+
+/**
+ * @brief The names of the phases, as printed by `dump`.
+ */
+static const char* PHASE_NAMES[PHASE_COUNT] = { "namelookup", "connect", "appconnect", "starttransfer", "total" };
+
+
+/**
+ * @brief Returns the bucket holding a time.
+ *
+ * Times below SUB_BUCKETS microseconds map to themselves. Larger ones are located by their
+ * highest set bit, and the next two bits pick one of the four buckets of that power of two.
+ */
+int TimingHistogram::bucket_for(curl_off_t time_us)
+{
+    if (time_us < SUB_BUCKETS)
+    {
+        return time_us > 0 ? static_cast<int>(time_us) : 0;
+    }
+
+    uint64_t value = static_cast<uint64_t>(time_us);
+    int exponent = 0;
+    while ((value >> exponent) >= 2 * SUB_BUCKETS)
+    {
+        exponent++;
+    }
+
+    // value >> exponent is now between SUB_BUCKETS and 2 * SUB_BUCKETS - 1
+    int bucket = SUB_BUCKETS + exponent * SUB_BUCKETS + static_cast<int>((value >> exponent) - SUB_BUCKETS);
+    return bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1;
+}
+
+/**
+ * @brief Returns the largest time held by a bucket, in microseconds.
+ */
+uint64_t TimingHistogram::bucket_upper_us(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    int exponent = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+    uint64_t mantissa = SUB_BUCKETS + (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+    return ((mantissa + 1) << exponent) - 1;
+}
+
+/**
+ * @brief Adds the phase times of one transfer.
+ *
+ * @param times_us The time of each phase in microseconds, indexed by TransferPhase.
+ */
+void TimingHistogram::add(const curl_off_t (&times_us)[PHASE_COUNT])
+{
+    this->transfers++;
+
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        this->counts[phase][bucket_for(times_us[phase])]++;
+        this->total_us[phase] += times_us[phase] > 0 ? times_us[phase] : 0;
+    }
+}
+
+/**
+ * @brief Adds the counts of another histogram to this one.
+ */
+void TimingHistogram::merge(const TimingHistogram& other)
+{
+    this->transfers += other.transfers;
+
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        for (int bucket = 0; bucket < BUCKET_COUNT; bucket++)
+        {
+            this->counts[phase][bucket] += other.counts[phase][bucket];
+        }
+        this->total_us[phase] += other.total_us[phase];
+    }
+}
+
+/**
+ * @brief Returns the exact mean time of a phase in milliseconds, or 0 if nothing was recorded.
+ */
+double TimingHistogram::mean_ms(TransferPhase phase) const
+{
+    if (this->transfers == 0)
+    {
+        return 0;
+    }
+
+    return this->total_us[phase] / 1000.0 / this->transfers;
+}
+
+/**
+ * @brief Returns a percentile of the times of a phase in milliseconds.
+ *
+ * @param phase The phase to report.
+ * @param percentile The percentile, between 0 and 1.
+ * @return double The upper bound of the bucket holding the percentile, or 0 if nothing was recorded.
+ */
+double TimingHistogram::percentile_ms(TransferPhase phase, double percentile) const
+{
+    if (this->transfers == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(percentile * (this->transfers - 1)) + 1;
+    uint64_t seen = 0;
+
+    for (int bucket = 0; bucket < BUCKET_COUNT; bucket++)
+    {
+        seen += this->counts[phase][bucket];
+        if (seen >= rank)
+        {
+            return bucket_upper_us(bucket) / 1000.0;
+        }
+    }
+
+    return bucket_upper_us(BUCKET_COUNT - 1) / 1000.0;
+}
+
+
+/**
+ * @brief Constructs an empty TransferStats object.
+ */
+TransferStats::TransferStats()
+{
+}
+
+/**
+ * @brief Destructor for the TransferStats class.
+ */
+TransferStats::~TransferStats()
+{
+}
+
+/**
+ * @brief Records the timings of a finished transfer.
+ *
+ * @param easy The easy handle of the transfer, before it is reset or reused.
+ * @param host The host the transfer was sent to.
+ */
+void TransferStats::record(CURL* easy, const std::string& host)
+{
+    curl_off_t times_us[PHASE_COUNT] = {};
+    curl_easy_getinfo(easy, CURLINFO_NAMELOOKUP_TIME_T, &times_us[NAMELOOKUP_PHASE]);
+    curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME_T, &times_us[CONNECT_PHASE]);
+    curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME_T, &times_us[APPCONNECT_PHASE]);
+    curl_easy_getinfo(easy, CURLINFO_STARTTRANSFER_TIME_T, &times_us[STARTTRANSFER_PHASE]);
+    curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &times_us[TOTAL_PHASE]);
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->overall.add(times_us);
+    this->per_host[host].add(times_us);
+}
+
+/**
+ * @brief Forgets every recorded transfer.
+ */
+void TransferStats::clear()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->overall = TimingHistogram();
+    this->per_host.clear();
+}
+
+/**
+ * @brief Returns a snapshot of the histogram of every transfer.
+ */
+TimingHistogram TransferStats::global()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->overall;
+}
+
+/**
+ * @brief Returns a snapshot of the histogram of one host, empty if it has no transfers.
+ */
+TimingHistogram TransferStats::host(const std::string& host)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    auto found = this->per_host.find(host);
+    return found != this->per_host.end() ? found->second : TimingHistogram();
+}
+
+/**
+ * @brief Returns the hosts with recorded transfers, sorted by name.
+ */
+std::vector<std::string> TransferStats::hosts()
+{
+    std::vector<std::string> names;
+
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        for (const auto& entry : this->per_host)
+        {
+            names.push_back(entry.first);
+        }
+    }
+
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+/**
+ * @brief Writes a table of the mean, p50, p90 and p99 of each phase, globally and per host.
+ *
+ * @param out The stream to write the table to.
+ */
+void TransferStats::dump(std::ostream& out)
+{
+    dump_histogram(out, "all hosts", this->global());
+
+    for (const std::string& name : this->hosts())
+    {
+        dump_histogram(out, name, this->host(name));
+    }
+}
+
+/**
+ * @brief Writes the table of one histogram.
+ */
+void TransferStats::dump_histogram(std::ostream& out, const std::string& name, const TimingHistogram& histogram)
+{
+    char line[128];
+
+    out << name << " (" << histogram.transfers << " transfers)\n";
+    std::snprintf(line, sizeof(line), "  %-14s %10s %10s %10s %10s\n", "phase", "mean ms", "p50 ms", "p90 ms", "p99 ms");
+    out << line;
+
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        TransferPhase current = static_cast<TransferPhase>(phase);
+        std::snprintf(line, sizeof(line), "  %-14s %10.2f %10.2f %10.2f %10.2f\n", PHASE_NAMES[phase],
+            histogram.mean_ms(current),
+            histogram.percentile_ms(current, 0.50),
+            histogram.percentile_ms(current, 0.90),
+            histogram.percentile_ms(current, 0.99));
+        out << line;
+    }
+}
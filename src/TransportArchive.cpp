@@ -0,0 +1,298 @@
+#include <TransportArchive.hpp>
+#include <Utilities.hpp>
+#include <Logger.hpp>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+
+/**
+ * @brief The bytes every archive starts with, including the format version.
+ */
+static const char ARCHIVE_MAGIC[8] = { 'W', 'C', 'A', 'R', 'C', 'H', 0, 1 };
+
+/**
+ * @brief Writes an integer in little-endian byte order, so archives move between machines.
+ */
+static void write_integer(std::ostream& out, uint64_t value, int bytes)
+{
+    char buffer[8];
+    for (int i = 0; i < bytes; i++)
+    {
+        buffer[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+    out.write(buffer, bytes);
+}
+
+/**
+ * @brief Writes a string prefixed with its length.
+ */
+static void write_string(std::ostream& out, const std::string& value, int length_bytes)
+{
+    write_integer(out, value.size(), length_bytes);
+    out.write(value.data(), value.size());
+}
+
+/**
+ * @brief Reads an integer written by `write_integer`.
+ *
+ * @return true if the integer was read, false at the end of the archive.
+ */
+static bool read_integer(std::istream& in, uint64_t& value, int bytes)
+{
+    unsigned char buffer[8];
+    if (!in.read(reinterpret_cast<char*>(buffer), bytes))
+    {
+        return false;
+    }
+
+    value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value |= static_cast<uint64_t>(buffer[i]) << (8 * i);
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the number of bytes left in a stream, or -1 if it cannot be sized.
+ */
+static long long remaining_bytes(std::istream& in)
+{
+    std::streampos position = in.tellg();
+    if (position < 0 || !in.seekg(0, std::ios::end))
+    {
+        in.clear();
+        return -1;
+    }
+
+    std::streampos end = in.tellg();
+    in.seekg(position);
+    return end < position ? -1 : static_cast<long long>(end - position);
+}
+
+/**
+ * @brief Reads a string written by `write_string`.
+ *
+ * The length comes from the archive, so it is checked against the bytes actually left before
+ * any memory is reserved for it; a truncated or corrupt length ends the read instead.
+ *
+ * @return true if the string was read, false at the end of the archive or if it is truncated.
+ */
+static bool read_string(std::istream& in, std::string& value, int length_bytes)
+{
+    uint64_t length;
+    if (!read_integer(in, length, length_bytes))
+    {
+        return false;
+    }
+
+    long long remaining = remaining_bytes(in);
+    if (remaining < 0 || length > static_cast<uint64_t>(remaining))
+    {
+        return false;
+    }
+
+    value.resize(length);
+    return length == 0 || static_cast<bool>(in.read(&value[0], length));
+}
+
+/**
+ * @brief Reads one archived response.
+ *
+ * @return true if a whole record was read, false at the end of the archive or if it is truncated.
+ */
+static bool read_response(std::istream& in, ArchivedResponse& response)
+{
+    uint64_t fetch_code, code, status, elapsed_ms, wire_bytes, has_body;
+
+    if (!read_string(in, response.url, 4) ||
+        !read_integer(in, fetch_code, 1) ||
+        !read_integer(in, code, 2) ||
+        !read_integer(in, status, 2) ||
+        !read_integer(in, elapsed_ms, 4) ||
+        !read_integer(in, wire_bytes, 8) ||
+        !read_string(in, response.headers, 4) ||
+        !read_integer(in, has_body, 1) ||
+        !read_string(in, response.body, 8))
+    {
+        return false;
+    }
+
+    response.fetch_code = static_cast<FetchCode>(fetch_code);
+    response.code = static_cast<CURLcode>(code);
+    response.status = static_cast<long>(status);
+    response.elapsed_ms = static_cast<long long>(elapsed_ms);
+    response.wire_bytes = static_cast<curl_off_t>(wire_bytes);
+    response.has_body = has_body != 0;
+    return true;
+}
+
+
+/**
+ * @brief Constructs a new RecordingTransport object.
+ *
+ * Any existing archive at the path is replaced.
+ *
+ * @param inner The Transport that performs the fetches, usually the curl_manager.
+ * @param archive_path The file to write the archive to.
+ */
+RecordingTransport::RecordingTransport(Transport* inner, const char* archive_path)
+{
+    this->inner = inner;
+    this->archive.open(archive_path, std::ios::binary | std::ios::trunc);
+
+    if (!this->archive)
+    {
+        LOG("Failed to open transport archive for writing: ", archive_path);
+        return;
+    }
+
+    this->archive.write(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    this->archive.flush();
+}
+
+/**
+ * @brief Destructor for the RecordingTransport class.
+ */
+RecordingTransport::~RecordingTransport()
+{
+}
+
+/**
+ * @brief Fetches a URL through the inner Transport and records the result.
+ *
+ * @param url The URL to send the GET request to.
+ * @return FetchResult The result of the inner Transport, unchanged.
+ */
+FetchResult RecordingTransport::fetch(const char* url)
+{
+    long long started_ms = now_ms();
+    FetchResult result = this->inner->fetch(url);
+    long long elapsed_ms = now_ms() - started_ms;
+
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if (!this->archive)
+    {
+        return result;
+    }
+
+    write_string(this->archive, url, 4);
+    write_integer(this->archive, result.fetch_code, 1);
+    write_integer(this->archive, result.code, 2);
+    write_integer(this->archive, result.status, 2);
+    write_integer(this->archive, elapsed_ms, 4);
+    write_integer(this->archive, result.wire_bytes, 8);
+    write_string(this->archive, result.headers, 4);
+    write_integer(this->archive, result.html_content != nullptr, 1);
+    write_string(this->archive, result.html_content != nullptr ? *result.html_content : std::string(), 8);
+    this->archive.flush();
+
+    this->records++;
+    return result;
+}
+
+/**
+ * @brief Returns the number of responses recorded so far.
+ */
+size_t RecordingTransport::recorded()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->records;
+}
+
+
+/**
+ * @brief Constructs a new ReplayTransport object and loads its archive.
+ *
+ * A missing or unreadable archive leaves the transport empty. A truncated final record,
+ * as left by an interrupted recording, is ignored.
+ *
+ * @param archive_path The archive written by a RecordingTransport.
+ * @param replay_timing Whether each fetch waits as long as it took when recorded.
+ */
+ReplayTransport::ReplayTransport(const char* archive_path, bool replay_timing)
+{
+    this->replay_timing = replay_timing;
+
+    std::ifstream archive(archive_path, std::ios::binary);
+    char magic[sizeof(ARCHIVE_MAGIC)];
+
+    if (!archive.read(magic, sizeof(magic)) || std::string(magic, sizeof(magic)) != std::string(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)))
+    {
+        LOG("Failed to load transport archive: ", archive_path);
+        return;
+    }
+
+    ArchivedResponse response;
+    while (read_response(archive, response))
+    {
+        this->responses[normalize_url(response.url)] = response;
+    }
+
+    LOG("Loaded ", this->responses.size(), " responses from transport archive: ", archive_path);
+}
+
+/**
+ * @brief Destructor for the ReplayTransport class.
+ */
+ReplayTransport::~ReplayTransport()
+{
+}
+
+/**
+ * @brief Returns the recorded response of a URL.
+ *
+ * @param url The URL to look up in the archive.
+ * @return FetchResult The recorded result, with a fresh copy of its body owned by the caller.
+ */
+FetchResult ReplayTransport::fetch(const char* url)
+{
+    FetchResult result;
+    result.url = url;
+    result.html_content = nullptr;
+    result.attempts = 1;
+    result.wire_bytes = 0;
+    result.decoded_bytes = 0;
+    result.from_cache = false;
+
+    auto found = this->responses.find(normalize_url(url));
+    if (found == this->responses.end())
+    {
+        LOG("No recorded response for: ", url);
+        result.fetch_code = FetchCode::PERMANENT_FETCH_ERROR;
+        result.code = CURLE_REMOTE_FILE_NOT_FOUND;
+        result.status = 0;
+        return result;
+    }
+
+    const ArchivedResponse& response = found->second;
+
+    if (this->replay_timing && response.elapsed_ms > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(response.elapsed_ms));
+    }
+
+    result.fetch_code = response.fetch_code;
+    result.code = response.code;
+    result.status = response.status;
+    result.headers = response.headers;
+    result.wire_bytes = response.wire_bytes;
+
+    if (response.has_body)
+    {
+        result.html_content = new std::string(response.body);
+        result.decoded_bytes = response.body.size();
+    }
+
+    return result;
+}
+
+/**
+ * @brief Returns the number of distinct URLs in the archive.
+ */
+size_t ReplayTransport::size()
+{
+    return this->responses.size();
+}
@@ -1,5 +1,187 @@
+#include <Utilities.hpp>
 #include <Logger.hpp>
 #include <CurlManager.hpp>
+#include <ResponseCache.hpp>
+#include <chrono>
 
 Logger logger;
-CurlManager curl_manager;
\ No newline at end of file
+CurlManager curl_manager;
+ResponseCache response_cache;
+
+
+/**
+ * @brief Normalizes a URL so that equivalent spellings of it compare equal.
+ *
+ * The scheme and host are lowercased, a default port (80 for http, 443 for https) is removed,
+ * an empty path becomes "/" and any fragment is dropped, since it is never sent to the server.
+ *
+ * @param url The URL to normalize.
+ * @return std::string The normalized URL, or the input unchanged if it has no scheme.
+ */
+std::string normalize_url(const std::string& url)
+{
+    size_t scheme_end = url.find("://");
+    if (scheme_end == std::string::npos)
+    {
+        return url;
+    }
+
+    std::string result = url.substr(0, url.find('#'));
+
+    size_t host_start = scheme_end + 3;
+    size_t host_end = result.find_first_of("/?", host_start);
+    if (host_end == std::string::npos)
+    {
+        host_end = result.size();
+    }
+
+    for (size_t i = 0; i < host_end; i++)
+    {
+        if (result[i] >= 'A' && result[i] <= 'Z')
+        {
+            result[i] = result[i] - 'A' + 'a';
+        }
+    }
+
+    std::string authority = result.substr(host_start, host_end - host_start);
+    std::string scheme = result.substr(0, scheme_end);
+
+    if ((scheme == "http" && authority.size() > 3 && authority.compare(authority.size() - 3, 3, ":80") == 0) ||
+        (scheme == "https" && authority.size() > 4 && authority.compare(authority.size() - 4, 4, ":443") == 0))
+    {
+        size_t port_start = authority.rfind(':');
+        result.erase(host_start + port_start, authority.size() - port_start);
+        host_end = host_start + port_start;
+    }
+
+    if (host_end == result.size() || result[host_end] != '/')
+    {
+        result.insert(host_end, "/");
+    }
+
+    return result;
+}
+
+/**
+ * @brief Extracts the host, including any port, from a URL.
+ *
+ * @param url The URL to extract the host from.
+ * @return std::string The lowercased host, or an empty string if the URL has no scheme.
+ */
+std::string url_host(const std::string& url)
+{
+    size_t scheme_end = url.find("://");
+    if (scheme_end == std::string::npos)
+    {
+        return "";
+    }
+
+    size_t host_start = scheme_end + 3;
+    size_t host_end = url.find_first_of("/?#", host_start);
+    if (host_end == std::string::npos)
+    {
+        host_end = url.size();
+    }
+
+    // Skip any credentials in front of the host
+    size_t at = url.rfind('@', host_end);
+    if (at != std::string::npos && at >= host_start)
+    {
+        host_start = at + 1;
+    }
+
+    std::string host = url.substr(host_start, host_end - host_start);
+    to_lower_ascii(host);
+
+    return host;
+}
+
+/**
+ * @brief Extracts the scheme and authority of a URL, such as "https://example.com".
+ *
+ * @param url The URL to extract the origin from.
+ * @return std::string The origin, or an empty string if the URL has no scheme.
+ */
+std::string url_origin(const std::string& url)
+{
+    size_t scheme_end = url.find("://");
+    if (scheme_end == std::string::npos)
+    {
+        return "";
+    }
+
+    size_t host_end = url.find_first_of("/?#", scheme_end + 3);
+    return url.substr(0, host_end);
+}
+
+/**
+ * @brief Extracts the path and query of a URL, without any fragment.
+ *
+ * @param url The URL to extract the path from.
+ * @return std::string The path and query, or "/" if the URL has no path.
+ */
+std::string url_path(const std::string& url)
+{
+    size_t scheme_end = url.find("://");
+    size_t path_start = url.find_first_of("/?#", scheme_end == std::string::npos ? 0 : scheme_end + 3);
+    if (path_start == std::string::npos || url[path_start] == '#')
+    {
+        return "/";
+    }
+
+    std::string path = url.substr(path_start, url.find('#', path_start) - path_start);
+    if (path[0] == '?')
+    {
+        path.insert(0, "/");
+    }
+
+    return path;
+}
+
+/**
+ * @brief Hashes a string with 64-bit FNV-1a.
+ *
+ * The hash is stable across runs and platforms, so it can name files on disk.
+ *
+ * @param value The string to hash.
+ * @return uint64_t The hash of the string.
+ */
+uint64_t hash_string(const std::string& value)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (unsigned char c : value)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Lowercases the ASCII letters of a string in place, leaving every other byte alone.
+ *
+ * @param value The string to lowercase.
+ */
+void to_lower_ascii(std::string& value)
+{
+    for (char& c : value)
+    {
+        if (c >= 'A' && c <= 'Z')
+        {
+            c = c - 'A' + 'a';
+        }
+    }
+}
+
+/**
+ * @brief Returns a monotonic timestamp in milliseconds.
+ *
+ * Only differences between two timestamps are meaningful.
+ */
+long long now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -1,6 +1,9 @@
 #include <WebPage.hpp>
 #include <Logger.hpp>
 #include <CurlManager.hpp>
+#include <ResponseCache.hpp>
+#include <HtmlTokenizer.hpp>
+#include <StructuralScanner.hpp>
 #include <cstring>
 #include <sstream>
 
@@ -79,16 +82,55 @@ std::string WebPage::translate_entity_s(std::string entity){
  * @brief Constructs a new WebPage object.
  * 
  * This constructor initializes a WebPage object with the given URL. It fetches the HTML content
- * from the URL using the curl_manager, initializes an empty deque for Tags, and allocates memory
+ * from the URL using the curl_manager, and allocates memory
  * for the Title and Description strings. The markdown_content is initialized to nullptr.
  * 
+ * When the response_cache holds the URL, the cached HTML is shared with the cache instead of
+ * being fetched, and freshly fetched HTML is added to the cache.
+ * 
  * @param url The URL of the web page to be fetched and processed.
+ * @param transport The Transport to fetch the page with, or nullptr for the curl_manager.
+ */
+WebPage::WebPage(const char *url, Transport* transport)
+{
+    this->url = new std::string(url);
+    this->cached_page = response_cache.lookup(url);
+
+    if (this->cached_page != nullptr)
+    {
+        LOG("Using cached HTML for URL: ", url);
+        this->html_content = this->cached_page->html;
+    }
+    else
+    {
+        if (transport == nullptr)
+        {
+            transport = &curl_manager;
+        }
+        this->html_content = std::shared_ptr<const std::string>(transport->fetch(url).html_content);
+        this->cache_html();
+    }
+    this->Title = new std::string();
+    this->Description = new std::string();
+    this->markdown_content = nullptr;
+
+    LOG("Created WebPage object for URL: ", this->url->c_str());
+}
+
+/**
+ * @brief Constructs a WebPage object around HTML that has already been fetched.
+ *
+ * Used by `fetch_async` once a transfer completes. The HTML is added to the response_cache.
+ *
+ * @param url The URL the HTML was fetched from.
+ * @param html_content The fetched HTML, or nullptr if the fetch failed. The WebPage takes ownership.
  */
-WebPage::WebPage(const char *url)
+WebPage::WebPage(const std::string& url, std::string* html_content)
 {
     this->url = new std::string(url);
-    this->html_content = curl_manager.get(url);
-    this->Tags = std::deque<Tag *>();
+    this->html_content = std::shared_ptr<const std::string>(html_content);
+    this->cache_html();
+
     this->Title = new std::string();
     this->Description = new std::string();
     this->markdown_content = nullptr;
@@ -96,6 +138,99 @@ WebPage::WebPage(const char *url)
     LOG("Created WebPage object for URL: ", this->url->c_str());
 }
 
+/**
+ * @brief Constructs a WebPage object around a page found in the response_cache.
+ *
+ * Used by `fetch_async`, so the page it looked up is the one used even if the cache evicts it
+ * in the meantime. The HTML is shared with the cache rather than copied.
+ *
+ * @param url The URL of the page.
+ * @param cached_page The cached page, not nullptr.
+ */
+WebPage::WebPage(const std::string& url, std::shared_ptr<const CachedPage> cached_page)
+{
+    LOG("Using cached HTML for URL: ", url);
+
+    this->url = new std::string(url);
+    this->cached_page = cached_page;
+    this->html_content = cached_page->html;
+
+    this->Title = new std::string();
+    this->Description = new std::string();
+    this->markdown_content = nullptr;
+
+    LOG("Created WebPage object for URL: ", this->url->c_str());
+}
+
+/**
+ * @brief Fetches a web page without blocking, through a CurlManager's multi handle.
+ *
+ * The request is queued with the manager's `submit`, and the future becomes ready from within
+ * its `poll` once the transfer has finished, so the thread driving `poll` can have thousands
+ * of pages in flight at once. Nothing progresses unless `poll` is called. A page held by the
+ * response_cache is ready immediately.
+ *
+ * A failed fetch still yields a WebPage, whose `scrape` returns NO_HTML_CONTENT, just as
+ * with the blocking constructor.
+ *
+ * Asynchronous fetches always go to the network: a RecordingTransport or ReplayTransport only
+ * wraps blocking fetches, so pages fetched here are neither recorded nor replayed.
+ *
+ * @param url The URL of the web page to be fetched.
+ * @param scrape Whether to scrape the page on the polling thread as soon as its body arrives.
+ * @param manager The CurlManager to queue the request on, or nullptr for the curl_manager.
+ * @return std::future<WebPage*> The page, owned by the caller once retrieved.
+ */
+std::future<WebPage*> WebPage::fetch_async(const char* url, bool scrape, CurlManager* manager)
+{
+    std::shared_ptr<std::promise<WebPage*>> promise = std::make_shared<std::promise<WebPage*>>();
+    std::future<WebPage*> future = promise->get_future();
+
+    std::shared_ptr<const CachedPage> cached_page = response_cache.lookup(url);
+    if (cached_page != nullptr)
+    {
+        WebPage* page = new WebPage(url, cached_page);
+        if (scrape)
+        {
+            page->scrape();
+        }
+        promise->set_value(page);
+        return future;
+    }
+
+    if (manager == nullptr)
+    {
+        manager = &curl_manager;
+    }
+
+    manager->submit(url, [promise, scrape](FetchResult& result)
+    {
+        WebPage* page = new WebPage(result.url, result.html_content);
+        if (scrape)
+        {
+            page->scrape();
+        }
+        promise->set_value(page);
+    });
+
+    return future;
+}
+
+/**
+ * @brief Adds freshly fetched HTML to the response_cache, if the cache is enabled.
+ */
+void WebPage::cache_html()
+{
+    if (this->html_content != nullptr && response_cache.enabled())
+    {
+        std::shared_ptr<CachedPage> page = std::make_shared<CachedPage>();
+        page->html = this->html_content;
+        page->scraped = false;
+        page->scrape_code = ScrapeCode::NO_SCRAPE_ERROR;
+        response_cache.store(*this->url, page);
+    }
+}
+
 /**
  * @brief Destructor for the WebPage class.
  *
@@ -103,17 +238,15 @@ WebPage::WebPage(const char *url)
  * associated with a WebPage object. It performs the following actions:
  * - Logs the deletion of the WebPage object along with its URL.
  * - Deletes the dynamically allocated URL string.
- * - Deletes the dynamically allocated HTML content string.
+ * - Releases its share of the HTML content string, which the response_cache may still hold.
  * - Deletes the dynamically allocated Title string.
  * - Deletes the dynamically allocated Description string.
  * - Deletes the dynamically allocated markdown content string if it is not nullptr.
- * - Iterates through the list of Tags and deletes each Tag object.
  */
 WebPage::~WebPage()
 {
     LOG("Deleted WebPage object for URL: ", this->url->c_str());
     delete this->url;
-    delete this->html_content;
     delete this->Title;
     delete this->Description;
 
@@ -121,11 +254,6 @@ WebPage::~WebPage()
     {
         delete this->markdown_content;
     }
-
-    for (Tag *tag : this->Tags)
-    {
-        delete tag;
-    }
 }
 
 /**
@@ -136,6 +264,11 @@ WebPage::~WebPage()
  * including opening, closing, and self-closing tags. The function also checks
  * for the presence of a DOCTYPE declaration and logs appropriate messages if
  * it is not found.
+ *
+ * Open tags are kept on a stack. When the innermost one is closed it becomes the
+ * last child of the tag below it, so the tree is built in time linear in the
+ * number of tags. A closing tag that does not match the innermost open tag is
+ * ignored. The tags are stored in the flat arrays of the page's TagTree.
  * 
  * @return TagParseCode 
  * 
@@ -147,20 +280,8 @@ WebPage::~WebPage()
  */
 TagParseCode WebPage::parseTagTree()
 {
-    
-    int start = -1;
-
-    std::string tag;
     TagType tag_type;
 
-    int start_open = 0;
-    // int start_close = 0;
-
-    int next_space = 0;
-    int next_forward_slash = 0;
-    TagOrganisation tag_organisation = TagOrganisation::OPENING;
-
-
     size_t pos = 0;
     pos = this->html_content->find("<!doctype html", 0);
     if (pos == std::string::npos)
@@ -181,83 +302,41 @@ TagParseCode WebPage::parseTagTree()
         }
     }
 
-    pos += 0xf;
-
-    int start_addition = 0;
-    int end_negation = 0;
-
-    std::deque<SingleTag *> tag_stack;
-
-    std::deque<Tag *> tag_branch;
-
-
-    while (pos < this->html_content->size())
+    // The open elements, innermost last, each with the last child it has collected
+    struct OpenTag
     {
-        // #########################################################################################
-        //
-        //           Reset variables for next iteration
-        //
-        // #########################################################################################
+        uint32_t tag;
+        uint32_t last_child;
+    };
+    std::vector<OpenTag> tag_stack;
 
-        start_addition = 0;
-        end_negation = 0;
+    // The last element with no open ancestor, the roots being linked in the order they closed
+    uint32_t last_root = TagTree::NO_TAG;
 
-        tag_organisation = TagOrganisation::None;
+    this->Tags.clear();
 
-        // #########################################################################################
-        //
-        //           Find Tags
-        //
-        // #########################################################################################
-
-
-        if (this->html_content->at(pos) != '<')
-        {
-            pos = this->html_content->find('<', pos);
-            if (pos == std::string::npos)
-            {
-                LOG("No more tags found");
-                break;
-            }
-        }
+    HtmlTokenizer tokenizer(*this->html_content, pos);
+    HtmlToken token;
 
+    while (tokenizer.next(token))
+    {
         // #########################################################################################
         //
-        //           Find Tag organisation (opening, closing, self-closing)
-        //                 + Calculate offset for tag type
+        //           Skip everything but opening and closing tags
         //
         // #########################################################################################
 
-        start_open = pos;
-        pos = this->html_content->find('>', pos);
-        tag = this->html_content->substr(start_open, pos - start_open + 1);
-        // LOG("Found tag: ", tag, " at pos: ", start_open, " to ", pos);
-
-
-        tag_organisation = SingleTag::getTagOrganisation(this->html_content, start_open, pos);
-        if (tag_organisation == TagOrganisation::CLOSING)
-        {
-            start_addition = 1;
-        }
-        else if (tag_organisation == TagOrganisation::SELF_CLOSING)
+        if (token.type != HtmlTokenType::OPEN_TOKEN && token.type != HtmlTokenType::CLOSE_TOKEN)
         {
-            end_negation = 1;
+            // Self closing tags hold no text
+            continue;
         }
 
         // ###################################################################################
         //
         //          Find tag type
 
-        next_space = this->html_content->find(' ', start_open); 
-
-        if (next_space == std::string::npos || next_space > pos)
-        {
-            tag_type = stringToTagType(this->html_content->substr(start_open + 1 + start_addition, pos - start_open - start_addition - 1 - end_negation));
-        }
-        else
-        {
-            tag_type = stringToTagType(this->html_content->substr(start_open + 1 + start_addition, next_space - start_open - 1 - start_addition));
-        }
+        tag_type = stringToTagType(token.name);
 
         // ###################################################################################
         //
@@ -265,7 +344,7 @@ TagParseCode WebPage::parseTagTree()
         //
         // ###################################################################################
 
-        if (tag_organisation == TagOrganisation::OPENING){
+        if (token.type == HtmlTokenType::OPEN_TOKEN){
             // LOG("Pushed opening tag");
 
             switch (tag_type)
@@ -298,22 +377,7 @@ TagParseCode WebPage::parseTagTree()
 
             }
 
-            SingleTag *sTag = new SingleTag(tag_type, start_open, pos);
-            tag_stack.push_front(sTag);
-            continue;
-        }
-
-        // ###################################################################################
-        //
-        //          Exit Early from function as self closing tags hold no text
-        //
-        // ###################################################################################
-
-
-        if (tag_organisation == TagOrganisation::SELF_CLOSING)
-        {
-            //Handle self closing tags that contain links
-
+            tag_stack.push_back({ this->Tags.add(tag_type, static_cast<int>(token.start), static_cast<int>(token.end)), TagTree::NO_TAG });
             continue;
         }
 
@@ -329,68 +393,60 @@ TagParseCode WebPage::parseTagTree()
             continue;
         }
 
-        SingleTag *sTag = tag_stack.front();
+        uint32_t new_tag = tag_stack.back().tag;
 
 
-        if (tag_type != *sTag->tag_type)
+        if (tag_type != this->Tags.get(new_tag).Name())
         {
             continue;
         }
-        tag_stack.pop_front();
-
-
-        Tag *new_tag = new Tag(*sTag->tag_type, *sTag->start_open, *sTag->start_close, start_open, pos);
+        tag_stack.pop_back();
 
-        delete sTag;
+        this->Tags.close(new_tag, static_cast<int>(token.start), static_cast<int>(token.end));
 
         // ###################################################################################
         //
-        //          Add tag to the tree
+        //          Add tag to the tree: its children were attached as they closed, and
+        //          it becomes the next child of the element it was opened in
         //
         // ###################################################################################
 
 
-        if (tag_branch.empty()) // only happens for the first tag
+        if (tag_stack.empty())
         {
-            tag_branch.push_back(new_tag);
+            this->Tags.link(TagTree::NO_TAG, last_root, new_tag);
+            last_root = new_tag;
             continue;
         }
 
-        for (Tag* orphaned_node : tag_branch){
-
-            if (*new_tag->start_open < *orphaned_node->start_open && *orphaned_node->end_close < *new_tag->end_close)
-            {
-                new_tag->Children.push_back(orphaned_node);
-                orphaned_node->Parent = new_tag;
-            }
-        }
-
-        for (int i = 0; i < new_tag->Children.size(); i++){
-
-            auto it = std::find(tag_branch.begin(), tag_branch.end(), new_tag->Children[i]);
-            if (it != tag_branch.end()) {
-                tag_branch.erase(it);
-            }
-        }
-
-        tag_branch.push_back(new_tag);
+        this->Tags.link(tag_stack.back().tag, tag_stack.back().last_child, new_tag);
+        tag_stack.back().last_child = new_tag;
     }
 
     if (!tag_stack.empty())
     {
         LOG("Unclosed tags found");
 
-        for (SingleTag *sTag : tag_stack)
+        // The children of unclosed tags are left without a parent, outermost first. The
+        // unclosed tags themselves stay in the arrays, unreachable from the roots
+        for (const OpenTag& unclosed : tag_stack)
         {
-            LOG("Unclosed tag: ", tagTypeToString(*sTag->tag_type));
-            delete sTag;
+            Tag tag = this->Tags.get(unclosed.tag);
+            LOG("Unclosed tag: ", tagTypeToString(tag.Name()));
+
+            Tag child = tag.first_child();
+            while (child)
+            {
+                Tag next = child.next_sibling();
+                this->Tags.link(TagTree::NO_TAG, last_root, child.index);
+                last_root = child.index;
+                child = next;
+            }
         }
-        this->Tags = tag_branch;
         return TagParseCode::HTML_MALFORMED;
     }
 
     LOG("No unclosed tags found");
-    this->Tags = tag_branch;
     return TagParseCode::NO_TAG_PARSE_ERROR;
 
 }
@@ -402,6 +458,7 @@ TagParseCode WebPage::parseTagTree()
  *
  * This function processes the input markdown content to ensure that there are no more than two consecutive new lines.
  * Additionally, it translates HTML entities (e.g., &amp;, &lt;, &gt;) into their corresponding characters.
+ * Runs of text between new lines and entities are found with a StructuralScanner and copied whole.
  *
  * @param content The markdown content to be sanitized. This parameter is passed by reference.
  * @return A sanitized version of the input markdown content.
@@ -409,11 +466,15 @@ TagParseCode WebPage::parseTagTree()
 std::string WebPage::sanitize_markdown(std::string& content){
 
     std::string sanitized_content = "";
+    sanitized_content.reserve(content.size());
 
-    int pos = 0;
-    int end = 0;
+    size_t pos = 0;
+    size_t end = 0;
     int new_lines = 0;
 
+    const unsigned special = structural_mask(NEWLINE) | structural_mask(AMPERSAND);
+    StructuralScanner scanner(content, special);
+
     while (pos < content.size()){
         if (content.at(pos) == '\n'){
             new_lines++;
@@ -430,15 +491,27 @@ std::string WebPage::sanitize_markdown(std::string& content){
         }
 
 
-        if (content.at(pos) != '&'){
-            sanitized_content += content.at(pos);
+        if (content.at(pos) == '\n'){
+            sanitized_content += '\n';
             pos++;
             continue;
         }
 
+        if (content.at(pos) != '&'){
+            // Copy everything up to the next new line or entity at once
+            scanner.seek(pos + 1);
+            size_t next = scanner.next();
+            if (next == std::string::npos){
+                next = content.size();
+            }
+            sanitized_content.append(content, pos, next - pos);
+            pos = next;
+            continue;
+        }
+
 
         end = 0;
-        for (int i = pos; i < content.size() && !(i - pos > 10); i++){
+        for (size_t i = pos; i < content.size() && !(i - pos > 10); i++){
             if (content.at(i) == ';'){
                 end = i;
                 break;
@@ -498,6 +571,10 @@ WriteCode WebPage::write_markdown(){
  *         - ScrapeCode::NO_DOCTYPE_FOUND: No DOCTYPE found in the HTML.
  *         - ScrapeCode::MALFORMED_HTML: HTML is malformed and unable to generate a full tree.
  *         - ScrapeCode::NO_SCRAPE_ERROR: Scraping completed successfully without errors.
+ * 
+ * If the page came from the response_cache and was already scraped, the cached markdown is
+ * reused without parsing the HTML again. Otherwise the rendered markdown is added to the
+ * page's cache entry, which keeps the expiry time it was given when the HTML was fetched.
  */
 ScrapeCode WebPage::scrape()
 {
@@ -509,6 +586,16 @@ ScrapeCode WebPage::scrape()
     }
 
 
+    if (this->cached_page != nullptr && this->cached_page->scraped)
+    {
+        LOG("Using cached markdown for URL: ", this->url->c_str());
+
+        this->markdown_content = new std::string(this->cached_page->markdown);
+        this->marked_down = true;
+
+        return this->cached_page->scrape_code;
+    }
+
     LOG("Scraping URL: ", this->url->c_str());
 
     TagParseCode error = this->parseTagTree();
@@ -531,8 +618,8 @@ ScrapeCode WebPage::scrape()
         default:
         {
             std::string content = "";
-            for (Tag* tag : this->Tags){
-                content += tag->getContent(this->html_content);
+            for (Tag tag = this->Tags.first_root(); tag; tag = tag.next_sibling()){
+                content += tag.getContent(this->html_content.get());
             }
             content = "# URL: \n- " + *this->url + "\n\n" + content;
             this->markdown_content = new std::string(sanitize_markdown(content));
@@ -543,11 +630,22 @@ ScrapeCode WebPage::scrape()
 
     LOG("Finished scraping URL: ", this->url->c_str());
 
+    ScrapeCode code = ScrapeCode::NO_SCRAPE_ERROR;
     if (error == TagParseCode::HTML_MALFORMED){
-        return ScrapeCode::MALFORMED_HTML;
+        code = ScrapeCode::MALFORMED_HTML;
+    }
+
+    if (response_cache.enabled())
+    {
+        std::shared_ptr<CachedPage> page = std::make_shared<CachedPage>();
+        page->html = this->html_content;
+        page->markdown = *this->markdown_content;
+        page->scraped = true;
+        page->scrape_code = code;
+        response_cache.update(*this->url, page);
     }
 
-    return ScrapeCode::NO_SCRAPE_ERROR;
+    return code;
 }
 
 /**
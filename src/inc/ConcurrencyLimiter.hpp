@@ -0,0 +1,49 @@
+#pragma once
+
+/**
+ * @class ConcurrencyLimiter
+ * @brief Adapts a concurrency limit to the latency and failures of completed requests (AIMD).
+ *
+ * Each completed request reports its round-trip time and whether it was dropped. While the
+ * limit is in use, every good sample grows it by 1/limit, so it rises by about one per
+ * round trip. A dropped request (timeout, 429, 5xx) halves it, and a round trip more than
+ * twice the baseline trims it by 10%, as queueing somewhere on the path is building up.
+ * At most one decrease is applied per round trip, so a burst of failures from one overload
+ * does not collapse the limit. The baseline is the shortest round trip of the previous
+ * window of samples, so it follows the path when it changes.
+ *
+ * Round trips are only comparable for one destination, so a limiter spanning many hosts
+ * should not judge latency, and only back off on dropped requests.
+ *
+ * Not thread-safe; the CurlManager drives it from the thread calling `poll`.
+ */
+class ConcurrencyLimiter
+{
+    public:
+
+        ConcurrencyLimiter(int initial_limit = 16, int min_limit = 1, int max_limit = 256);
+        ~ConcurrencyLimiter();
+
+        void configure(int initial_limit, int min_limit, int max_limit);
+        void on_sample(long long rtt_ms, bool dropped, int in_flight, long long now_ms, bool judge_latency = true);
+
+        int limit() const;
+        long long baseline_rtt_ms() const;
+
+    private:
+
+        static const int WINDOW_SAMPLES = 250;
+
+        double current;
+        int min_limit;
+        int max_limit;
+
+        long long baseline_ms = -1;      /**< The shortest round trip of the previous window */
+        long long window_min_ms = -1;    /**< The shortest round trip of the current window */
+        int window_samples = 0;
+        double smoothed_rtt_ms = -1;     /**< A moving average of the round trip, pacing decreases */
+        long long last_decrease_ms = -1;
+
+        bool inflated(long long rtt_ms);
+        void decrease(double factor, long long now_ms);
+};
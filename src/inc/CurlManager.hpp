@@ -1,9 +1,51 @@
 #pragma once
 
 #include <curl/curl.h>
+#include <ConcurrencyLimiter.hpp>
+#include <HttpCache.hpp>
+#include <HostScheduler.hpp>
+#include <TransferStats.hpp>
+#include <Transport.hpp>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
-class CurlManager {
+typedef std::function<void(FetchResult& result)> FetchCallback;
+
+/**
+ * @brief Receives each chunk of a streamed response body as it arrives.
+ *
+ * Returning false aborts the transfer.
+ */
+typedef std::function<bool(const char* data, size_t length)> ChunkCallback;
+
+/**
+ * @enum FetchBackend
+ * @brief Selects how the CurlManager waits for socket activity on its multi handle.
+ */
+enum FetchBackend
+{
+    POLL_BACKEND,       /**< curl_multi_perform + curl_multi_poll, available everywhere */
+    SOCKET_BACKEND      /**< curl_multi_socket_action driven by epoll, Linux only */
+};
+
+/**
+ * @class CurlManager
+ * @brief Performs HTTP requests through libcurl.
+ *
+ * This is the live Transport used by WebPage unless another one is given.
+ *
+ * Blocking `get` calls are safe from any number of threads, each using its own easy handle
+ * and its own connections. Every handle shares the DNS cache and TLS sessions, which libcurl
+ * guards with the share locks; connections are never shared across threads. The concurrent `submit`/`poll` interface shares one multi handle and must be driven from a
+ * single thread.
+ */
+class CurlManager : public Transport {
 
     public:
 
@@ -11,12 +53,143 @@ class CurlManager {
         ~CurlManager();
 
         std::string* get(const char* url);
+        FetchResult fetch(const char* url) override;
+        FetchResult fetch_unfiltered(const char* url, long max_redirects);
+        CURLcode get_stream(const char* url, ChunkCallback on_chunk);
+
+        void submit(const char* url, FetchCallback on_complete);
+        void submit_stream(const char* url, ChunkCallback on_chunk, FetchCallback on_complete);
+        int poll(int timeout_ms = 0);
+        bool idle();
+        void get_many(const std::vector<std::string>& urls, FetchCallback on_complete);
+
+        void set_max_in_flight(int max_in_flight);
+        void set_host_limits(double rate, double burst, int max_connections);
+        void set_host_rate(const std::string& host, double rate, double burst);
+        void reset_host_rate(const std::string& host);
+        bool set_backend(FetchBackend backend);
+        void set_compression(bool enabled);
+        void set_http_cache(HttpCache* cache);
+        void set_http2(bool enabled, long max_streams_per_host = 100);
+        void set_timeouts(long connect_ms, long low_speed_bytes, long low_speed_seconds, long total_ms);
+        void set_retry_policy(int max_attempts, long base_delay_ms, long max_delay_ms);
+        void set_content_limits(size_t max_body_bytes, const std::vector<std::string>& accepted_types);
+        void set_adaptive_concurrency(bool enabled, int max_limit = 256, int max_host_limit = 16);
+        int get_concurrency_limit();
+        int get_host_concurrency_limit(const std::string& host);
+        void set_hedging(bool enabled, double percentile = 0.95, double budget_percent = 5.0);
+        long long get_hedge_delay_ms();
+        TransferStats& get_transfer_stats();
 
     private:
 
-        CURL *curl;
+        /**
+         * @struct Transfer
+         * @brief A queued or in-flight request on the multi handle.
+         */
+        struct Transfer
+        {
+            CurlManager* manager = nullptr;  /**< The manager performing the transfer, set when it starts */
+            CURL* easy;                  /**< The easy handle driving the transfer, nullptr while queued */
+            std::string url;             /**< The URL being requested */
+            std::string host;            /**< The host of the URL, used for per-host scheduling */
+            std::string* html_content;   /**< The body received so far, nullptr when streaming */
+            size_t decoded_bytes = 0;    /**< The number of body bytes delivered so far */
+            int attempts = 0;            /**< The number of attempts started so far */
+            long long retry_after_ms = -1;   /**< The delay requested by a Retry-After header, or -1 */
+            std::string response_headers;    /**< The header lines of the final response, status line first */
+            std::string content_type;    /**< The media type of the response, lowercased and without parameters */
+            bool content_encoded = false;    /**< Whether the body arrives compressed, so Content-Length is not its decoded size */
+            FetchCode rejection = NO_FETCH_ERROR;    /**< Why the transfer was aborted early, if it was */
+            curl_slist* request_headers = nullptr;   /**< Extra request headers, freed once the transfer completes */
+            CacheValidators validators;  /**< The validators of the response, captured for the disk cache */
+            CacheValidators conditional; /**< The cached validators sent with the request, which a 304 confirms */
+            bool unconditional = false;  /**< Whether to leave out the cached validators, after a 304 whose cached body was unreadable */
+            bool unfiltered = false;     /**< Whether to skip the content limits set with `set_content_limits` */
+            long max_redirects = 0;      /**< The number of redirects to follow, or 0 to report the redirect itself */
+            long long started_ms = 0;    /**< When the current attempt was started */
+            long long first_byte_ms = -1;    /**< When the first response byte of the current attempt arrived, or -1 */
+            Transfer* twin = nullptr;    /**< The other attempt racing this one when hedged */
+            bool hedge_listed = false;   /**< Whether the transfer is waiting in `hedge_candidates` */
+            std::list<Transfer*>::iterator hedge_position;   /**< The transfer's place in `hedge_candidates` */
+            std::list<Transfer*>::iterator active_position;  /**< The transfer's place in `active` while on the multi handle */
+            ChunkCallback on_chunk;      /**< Receives the body as it arrives instead of buffering it */
+            FetchCallback on_complete;   /**< Invoked once the transfer has finished */
+        };
+
+        unsigned long long id;       /**< Identifies the manager's per-thread handles, unique for the life of the process */
+        CURLM *multi;
+        CURLSH *share;
+        std::mutex share_locks[CURL_LOCK_DATA_LAST];
+
+        HostScheduler<Transfer*> pending;
+        std::multimap<long long, Transfer*> retries;
+        std::vector<CURL*> free_handles;
+        std::list<Transfer*> active;
+        int in_flight = 0;
+        int max_in_flight = 16;
+
+        bool adaptive = false;
+        int max_host_limit = 16;
+        ConcurrencyLimiter global_limiter;
+        std::unordered_map<std::string, ConcurrencyLimiter> host_limiters;
+
+        bool http2 = false;
+        bool compression = true;
+        HttpCache* http_cache = nullptr;
+        TransferStats transfer_stats;
+
+        size_t max_body_bytes = 32 * 1024 * 1024;
+        std::vector<std::string> accepted_types = { "text/html", "application/xhtml+xml", "text/plain" };
+
+        long connect_timeout_ms = 10000;
+        long low_speed_bytes = 1;
+        long low_speed_seconds = 30;
+        long total_timeout_ms = 120000;
+
+        bool hedging = false;
+        double hedge_percentile = 0.95;
+        double hedge_budget_percent = 5.0;
+        long long hedge_delay_ms = -1;
+        long long requests_started = 0;
+        long long hedges_started = 0;
+        std::list<Transfer*> hedge_candidates;
+        std::vector<long long> first_byte_samples;
+        size_t next_sample = 0;
+        int samples_since_update = 0;
+
+        int max_attempts = 3;
+        long retry_base_delay_ms = 500;
+        long retry_max_delay_ms = 30000;
+
+        FetchBackend backend = POLL_BACKEND;
+        int epoll_fd = -1;
+        long long timer_deadline_ms = -1;
+
+        FetchResult fetch_blocking(Transfer& transfer);
+        CURLcode perform(Transfer& transfer);
+        void attach_transfer(Transfer& transfer);
+        FetchResult complete_transfer(Transfer& transfer, CURLcode code);
+        bool should_retry(const Transfer& transfer, const FetchResult& result);
+        long long retry_delay_ms(const Transfer& transfer, const FetchResult& result);
+        bool accept_response(Transfer& transfer);
+        void start_pending();
+        void launch_transfer(Transfer* transfer);
+        void start_hedges();
+        void cancel_transfer(Transfer* transfer);
+        void record_first_byte(long long first_byte_ms);
+        void adapt_concurrency(const Transfer& transfer, const FetchResult& result);
+        void configure_handle(CURL* easy);
+        void collect_completed();
+        int wait_sockets(int timeout_ms);
+        int wait_timeout_ms(int timeout_ms);
 
         static size_t write_callback(void* ptr, size_t size, size_t nmemb, void* userdata);
+        static size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata);
+        static int socket_callback(CURL* easy, curl_socket_t socket, int what, void* userp, void* socketp);
+        static int timer_callback(CURLM* multi, long timeout_ms, void* userp);
+        static void share_lock(CURL* easy, curl_lock_data data, curl_lock_access access, void* userp);
+        static void share_unlock(CURL* easy, curl_lock_data data, void* userp);
 };
 
 extern CurlManager curl_manager;
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @class HostScheduler
+ * @brief Queues work per host and releases it under a per-host rate and connection limit.
+ *
+ * Every host has a token bucket refilled at `rate` requests per second up to `burst` tokens,
+ * and may have at most `max_connections` items active at once. Items for a host that is out
+ * of tokens or connections stay parked in that host's queue, and `pop_ready` moves on to the
+ * next host, so one throttled host never holds up the others. Hosts with work are served
+ * round-robin.
+ *
+ * A rate or connection limit of zero means unlimited, which is the default.
+ *
+ * @tparam Item The type of the queued work items.
+ */
+template <typename Item>
+class HostScheduler
+{
+    public:
+
+        HostScheduler() {}
+        ~HostScheduler() {}
+
+        /**
+         * @brief Sets the limits applied to every host without a rate of its own.
+         *
+         * @param rate The sustained requests per second allowed to each host, or 0 for no limit.
+         * @param burst The number of requests a host may receive at once after being idle.
+         * @param max_connections The number of items a host may have active at once, or 0 for no limit.
+         */
+        void set_default_limits(double rate, double burst, int max_connections)
+        {
+            this->default_rate = rate;
+            this->default_burst = burst < 1 ? 1 : burst;
+            this->max_connections = max_connections;
+
+            for (auto& entry : this->hosts)
+            {
+                if (!entry.second.custom_rate)
+                {
+                    entry.second.rate = this->default_rate;
+                    entry.second.burst = this->default_burst;
+                }
+            }
+        }
+
+        /**
+         * @brief Overrides the request rate of a single host, for example from its robots.txt.
+         *
+         * @param host The host to limit.
+         * @param rate The sustained requests per second allowed to the host, or 0 for no limit.
+         * @param burst The number of requests the host may receive at once after being idle.
+         */
+        void set_host_rate(const std::string& host, double rate, double burst)
+        {
+            Host& state = this->host_state(host);
+            state.rate = rate;
+            state.burst = burst < 1 ? 1 : burst;
+            state.custom_rate = true;
+
+            if (state.tokens > state.burst)
+            {
+                state.tokens = state.burst;
+            }
+        }
+
+        /**
+         * @brief Drops a rate set with `set_host_rate`, so the host goes back to the default limits.
+         *
+         * @param host The host whose rate to reset.
+         */
+        void reset_host_rate(const std::string& host)
+        {
+            auto found = this->hosts.find(host);
+            if (found == this->hosts.end())
+            {
+                return;
+            }
+
+            Host& state = found->second;
+            state.rate = this->default_rate;
+            state.burst = this->default_burst;
+            state.custom_rate = false;
+
+            if (state.tokens > state.burst)
+            {
+                state.tokens = state.burst;
+            }
+        }
+
+        /**
+         * @brief Overrides the connection limit of a single host, for example from an adaptive limiter.
+         *
+         * A host blocked at its old limit is woken if the new one leaves room.
+         *
+         * @param host The host to limit.
+         * @param max_connections The number of items the host may have active at once, 0 for no
+         *        limit, or -1 to go back to the default limit.
+         */
+        void set_host_connections(const std::string& host, int max_connections)
+        {
+            Host& state = this->host_state(host);
+            state.max_connections = max_connections;
+
+            if (state.status == HostStatus::BLOCKED && !this->at_connection_limit(state))
+            {
+                state.status = HostStatus::RUNNABLE;
+                this->runnable.push_back(host);
+            }
+        }
+
+        /**
+         * @brief Returns the number of items of a host taken by `pop_ready` and not yet released.
+         */
+        int active(const std::string& host)
+        {
+            auto found = this->hosts.find(host);
+            return found != this->hosts.end() ? found->second.active : 0;
+        }
+
+        /**
+         * @brief Queues an item behind any others for the same host.
+         *
+         * @param host The host the item will be sent to.
+         * @param item The item to queue.
+         */
+        void push(const std::string& host, Item item)
+        {
+            Host& state = this->host_state(host);
+            state.queue.push_back(item);
+            this->queued++;
+
+            if (state.status == HostStatus::IDLE)
+            {
+                state.status = HostStatus::RUNNABLE;
+                this->runnable.push_back(host);
+            }
+        }
+
+        /**
+         * @brief Takes the next item whose host has both a token and a free connection.
+         *
+         * The host's token is consumed and the item counts as active until `release` is called.
+         *
+         * @param now_ms The current monotonic time in milliseconds.
+         * @param item Receives the item.
+         * @param host Receives the host of the item.
+         * @return true if an item was taken, false if every queued item is throttled.
+         */
+        bool pop_ready(long long now_ms, Item& item, std::string& host)
+        {
+            while (!this->sleeping.empty() && this->sleeping.begin()->first <= now_ms)
+            {
+                this->hosts[this->sleeping.begin()->second].status = HostStatus::RUNNABLE;
+                this->runnable.push_back(this->sleeping.begin()->second);
+                this->sleeping.erase(this->sleeping.begin());
+            }
+
+            while (!this->runnable.empty())
+            {
+                std::string name = this->runnable.front();
+                this->runnable.pop_front();
+                Host& state = this->hosts[name];
+
+                if (state.queue.empty())
+                {
+                    state.status = HostStatus::IDLE;
+                    continue;
+                }
+
+                if (this->at_connection_limit(state))
+                {
+                    // Woken again by release
+                    state.status = HostStatus::BLOCKED;
+                    continue;
+                }
+
+                this->refill(state, now_ms);
+                if (state.rate > 0 && state.tokens < 1)
+                {
+                    long long wait_ms = static_cast<long long>((1 - state.tokens) / state.rate * 1000) + 1;
+                    state.status = HostStatus::SLEEPING;
+                    this->sleeping.insert(std::make_pair(now_ms + wait_ms, name));
+                    continue;
+                }
+
+                state.tokens -= 1;
+                state.active++;
+                item = state.queue.front();
+                state.queue.pop_front();
+                this->queued--;
+
+                if (state.queue.empty())
+                {
+                    state.status = HostStatus::IDLE;
+                }
+                else
+                {
+                    this->runnable.push_back(name);
+                }
+
+                host = name;
+                return true;
+            }
+
+            return false;
+        }
+
+        /**
+         * @brief Takes a token and a connection of a host for an item started outside the queue.
+         *
+         * Nothing is taken unless the host has both, so the caller can skip the item instead
+         * of waiting. An item acquired this way is finished with `release`, like one taken by
+         * `pop_ready`.
+         *
+         * @param host The host the item will be sent to.
+         * @param now_ms The current monotonic time in milliseconds.
+         * @return true if the host had a token and a free connection, false otherwise.
+         */
+        bool try_acquire(const std::string& host, long long now_ms)
+        {
+            Host& state = this->host_state(host);
+            if (this->at_connection_limit(state))
+            {
+                return false;
+            }
+
+            this->refill(state, now_ms);
+            if (state.rate > 0 && state.tokens < 1)
+            {
+                return false;
+            }
+
+            state.tokens -= 1;
+            state.active++;
+            return true;
+        }
+
+        /**
+         * @brief Marks an item taken by `pop_ready` as finished, freeing its host's connection.
+         *
+         * @param host The host of the finished item.
+         * @param now_ms The current monotonic time in milliseconds.
+         */
+        void release(const std::string& host, long long now_ms)
+        {
+            auto found = this->hosts.find(host);
+            if (found == this->hosts.end())
+            {
+                return;
+            }
+
+            Host& state = found->second;
+            state.active--;
+
+            if (state.status == HostStatus::BLOCKED && !this->at_connection_limit(state))
+            {
+                state.status = HostStatus::RUNNABLE;
+                this->runnable.push_back(host);
+                return;
+            }
+
+            // Forget hosts that are fully idle, once forgetting them cannot allow an extra burst
+            this->refill(state, now_ms);
+            if (state.status == HostStatus::IDLE && state.active == 0 && !state.custom_rate && state.max_connections < 0 &&
+                (state.rate <= 0 || state.tokens >= state.burst))
+            {
+                this->hosts.erase(found);
+            }
+        }
+
+        /**
+         * @brief Returns how long until a parked host may receive its next item.
+         *
+         * @param now_ms The current monotonic time in milliseconds.
+         * @return long long 0 if an item may be ready now, the milliseconds until the next
+         *         token refill, or -1 if nothing is waiting on a timer.
+         */
+        long long next_wake_ms(long long now_ms)
+        {
+            if (!this->runnable.empty())
+            {
+                return 0;
+            }
+
+            if (this->sleeping.empty())
+            {
+                return -1;
+            }
+
+            long long wait_ms = this->sleeping.begin()->first - now_ms;
+            return wait_ms < 0 ? 0 : wait_ms;
+        }
+
+        /**
+         * @brief Returns the number of items queued and not yet taken.
+         */
+        size_t size()
+        {
+            return this->queued;
+        }
+
+        /**
+         * @brief Removes and returns every queued item, forgetting all host state.
+         */
+        std::deque<Item> drain()
+        {
+            std::deque<Item> items;
+
+            for (auto& entry : this->hosts)
+            {
+                for (Item& item : entry.second.queue)
+                {
+                    items.push_back(item);
+                }
+            }
+
+            this->hosts.clear();
+            this->runnable.clear();
+            this->sleeping.clear();
+            this->queued = 0;
+
+            return items;
+        }
+
+    private:
+
+        /**
+         * @enum HostStatus
+         * @brief Where a host is waiting within the scheduler.
+         */
+        enum HostStatus
+        {
+            IDLE,           /**< No queued items */
+            RUNNABLE,       /**< Listed in `runnable` */
+            SLEEPING,       /**< Listed in `sleeping` until its next token */
+            BLOCKED         /**< At its connection limit, until an item is released */
+        };
+
+        /**
+         * @struct Host
+         * @brief The queue and limits of a single host.
+         */
+        struct Host
+        {
+            std::deque<Item> queue;
+            double rate = 0;
+            double burst = 1;
+            double tokens = 1;
+            long long refilled_ms = -1;
+            int active = 0;
+            int max_connections = -1;      /**< The host's own connection limit, or -1 to use the default */
+            bool custom_rate = false;
+            HostStatus status = HostStatus::IDLE;
+        };
+
+        std::unordered_map<std::string, Host> hosts;
+        std::deque<std::string> runnable;
+        std::multimap<long long, std::string> sleeping;
+        size_t queued = 0;
+
+        double default_rate = 0;
+        double default_burst = 1;
+        int max_connections = 0;
+
+        Host& host_state(const std::string& host)
+        {
+            auto found = this->hosts.find(host);
+            if (found != this->hosts.end())
+            {
+                return found->second;
+            }
+
+            Host& state = this->hosts[host];
+            state.rate = this->default_rate;
+            state.burst = this->default_burst;
+            state.tokens = this->default_burst;
+            return state;
+        }
+
+        bool at_connection_limit(const Host& state)
+        {
+            int limit = state.max_connections >= 0 ? state.max_connections : this->max_connections;
+            return limit > 0 && state.active >= limit;
+        }
+
+        void refill(Host& state, long long now_ms)
+        {
+            if (state.refilled_ms != -1 && state.rate > 0)
+            {
+                state.tokens += (now_ms - state.refilled_ms) * state.rate / 1000.0;
+                if (state.tokens > state.burst)
+                {
+                    state.tokens = state.burst;
+                }
+            }
+
+            state.refilled_ms = now_ms;
+        }
+};
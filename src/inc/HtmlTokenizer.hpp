@@ -0,0 +1,68 @@
+#pragma once
+
+#include <StructuralScanner.hpp>
+#include <cstddef>
+#include <string_view>
+
+/**
+ * @enum HtmlTokenType
+ * @brief The kinds of token produced by the HtmlTokenizer.
+ */
+enum HtmlTokenType
+{
+    TEXT_TOKEN,             /**< A run of text between tags */
+    OPEN_TOKEN,             /**< An opening tag, such as <div class="a"> */
+    CLOSE_TOKEN,            /**< A closing tag, such as </div> */
+    SELF_CLOSING_TOKEN,     /**< A self-closing tag, such as <br/> */
+    COMMENT_TOKEN,          /**< A comment, or a malformed tag read as one */
+    DECLARATION_TOKEN       /**< A <!...> or <?...?> declaration, such as the DOCTYPE */
+};
+
+/**
+ * @struct HtmlToken
+ * @brief One token of an HTML document, viewing the document's own bytes.
+ */
+struct HtmlToken
+{
+    HtmlTokenType type;
+    std::string_view name;   /**< The tag name as written, empty for text, comments and declarations */
+    std::string_view text;   /**< The whole token: the tag from '<' to '>', the text run, or the comment */
+    size_t start;            /**< The offset of the first byte of the token */
+    size_t end;              /**< The offset of the last byte of the token, the '>' for tags */
+};
+
+/**
+ * @class HtmlTokenizer
+ * @brief Splits HTML into tokens in a single forward pass, without allocating.
+ *
+ * Tokens are views into the document, which must outlive them. Each byte is examined a
+ * bounded number of times: text runs and tag bodies are skipped by jumping between the
+ * delimiters found by a StructuralScanner, and a '>' inside a quoted attribute value does not
+ * end its tag. The contents of <script> and <style> are raw text, so markup inside them is
+ * never mistaken for tags.
+ */
+class HtmlTokenizer
+{
+    public:
+
+        HtmlTokenizer(std::string_view html, size_t start = 0);
+        ~HtmlTokenizer();
+
+        bool next(HtmlToken& token);
+        size_t position() const;
+
+    private:
+
+        std::string_view html;
+        size_t pos;
+        StructuralScanner scanner;
+        size_t walked;                   /**< The offset the scanner's walk continues from */
+        std::string_view raw_text_tag;   /**< The element whose raw text is being read, if any */
+
+        size_t find(size_t from, char delimiter);
+        size_t find_next(char delimiter);
+        size_t next_delimiter();
+        bool read_tag(HtmlToken& token);
+        bool read_raw_text(HtmlToken& token);
+        void read_text(HtmlToken& token, size_t end);
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+
+/**
+ * @struct CacheValidators
+ * @brief The validators a server sent with a cached response, replayed on revalidation.
+ */
+struct CacheValidators
+{
+    std::string etag;              /**< The ETag header, sent back as If-None-Match */
+    std::string last_modified;     /**< The Last-Modified header, sent back as If-Modified-Since */
+};
+
+/**
+ * @class HttpCache
+ * @brief A persistent on-disk cache of response bodies keyed by normalized URL.
+ *
+ * Each entry is stored as one `.entry` file named after the hash of the normalized URL,
+ * holding the URL and its validators on the first lines followed by the raw body. The
+ * CurlManager sends the validators as conditional request headers and reuses the cached body
+ * when the server answers 304 Not Modified.
+ */
+class HttpCache
+{
+    public:
+
+        HttpCache(const char* directory = "./cache");
+        ~HttpCache();
+
+        bool lookup(const std::string& url, CacheValidators& validators);
+        std::string* load(const std::string& url, const CacheValidators& expected);
+        bool store(const std::string& url, const CacheValidators& validators, const std::string& body);
+
+    private:
+
+        std::string directory;
+
+        std::string path_for(const std::string& normalized_url);
+};
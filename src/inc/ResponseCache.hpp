@@ -0,0 +1,89 @@
+#pragma once
+
+#include <WebPage.hpp>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @struct CachedPage
+ * @brief A fetched page held by the ResponseCache, shared read-only between callers.
+ */
+struct CachedPage
+{
+    std::shared_ptr<const std::string> html;    /**< The raw HTML of the page, shared with the WebPages reading it */
+    std::string markdown;          /**< The rendered markdown, empty until the page has been scraped */
+    bool scraped;                  /**< Whether `markdown` and `scrape_code` are set */
+    ScrapeCode scrape_code;        /**< The result of scraping the page */
+};
+
+/**
+ * @class ResponseCache
+ * @brief A concurrent in-memory LRU cache of fetched and rendered pages, keyed by URL.
+ *
+ * The cache is split into shards with their own lock and LRU list, so lookups for different
+ * URLs rarely contend. Entries expire after a fixed time to live. The byte budget covers the
+ * whole cache: once the shards together hold more than it, the least recently used entry
+ * across all shards is evicted until they fit again. A budget of zero, the default, disables
+ * the cache.
+ */
+class ResponseCache
+{
+    public:
+
+        ResponseCache(size_t byte_budget = 0, long long ttl_ms = 60000);
+        ~ResponseCache();
+
+        void configure(size_t byte_budget, long long ttl_ms);
+        bool enabled();
+
+        std::shared_ptr<const CachedPage> lookup(const std::string& url);
+        void store(const std::string& url, std::shared_ptr<const CachedPage> page);
+        bool update(const std::string& url, std::shared_ptr<const CachedPage> page);
+        void clear();
+
+        size_t size_bytes();
+
+    private:
+
+        static const int SHARD_COUNT = 16;
+
+        /**
+         * @struct Entry
+         * @brief A cached page with its key, size and expiry time.
+         */
+        struct Entry
+        {
+            std::string url;
+            std::shared_ptr<const CachedPage> page;
+            size_t bytes;
+            long long expires_ms;
+            unsigned long long last_use;   /**< When the entry was last stored or looked up, from `use_clock` */
+        };
+
+        /**
+         * @struct Shard
+         * @brief An independently locked part of the cache, ordered from most to least recently used.
+         */
+        struct Shard
+        {
+            std::mutex lock;
+            std::list<Entry> entries;
+            std::unordered_map<std::string, std::list<Entry>::iterator> index;
+        };
+
+        Shard shards[SHARD_COUNT];
+        std::atomic<size_t> byte_budget;
+        std::atomic<size_t> total_bytes{0};
+        std::atomic<unsigned long long> use_clock{0};
+        std::atomic<long long> ttl_ms;
+
+        Shard& shard_for(const std::string& key);
+        void remove(Shard& shard, std::list<Entry>::iterator entry);
+        void trim();
+};
+
+extern ResponseCache response_cache;
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <CurlManager.hpp>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class RobotsRules
+ * @brief The compiled robots.txt rules of one host for one user agent.
+ *
+ * Rules without wildcards are stored in a byte trie, so the longest matching literal rule
+ * is found in a single walk along the path. Rules using `*` or `$` are kept separately,
+ * longest first, and only tried when they are longer than the best literal match. As in
+ * RFC 9309, the longest matching rule decides, and Allow wins a tie.
+ */
+class RobotsRules
+{
+    public:
+
+        RobotsRules();
+        ~RobotsRules();
+
+        void parse(const std::string& robots_txt, const std::string& user_agent);
+        void add_rule(const std::string& pattern, bool allow);
+        bool allowed(const std::string& path) const;
+
+        double crawl_delay;            /**< The Crawl-delay in seconds, or 0 if none was given */
+        bool disallow_all;             /**< Set when robots.txt could not be fetched because of a server error */
+
+    private:
+
+        /**
+         * @struct TrieNode
+         * @brief One byte of a literal rule, with the rule ending here if any.
+         */
+        struct TrieNode
+        {
+            std::vector<std::pair<char, int>> children;
+            int rule_length = -1;      /**< The length of the rule ending at this node, or -1 */
+            bool allow = false;        /**< Whether the rule ending at this node is an Allow */
+        };
+
+        /**
+         * @struct WildcardRule
+         * @brief A rule containing `*` or ending in `$`.
+         */
+        struct WildcardRule
+        {
+            std::string pattern;
+            bool allow;
+        };
+
+        std::vector<TrieNode> trie;
+        std::vector<WildcardRule> wildcards;
+
+        static bool match_wildcard(const char* pattern, const char* pattern_end, const char* path, const char* path_end);
+};
+
+/**
+ * @class RobotsCache
+ * @brief Fetches, compiles and caches robots.txt per host.
+ *
+ * robots.txt is fetched through the CurlManager the first time a host is checked and again
+ * once its entry expires, so checking a URL normally costs only a hash lookup and a walk of
+ * the compiled rules. A Crawl-delay is passed to the CurlManager as the host's request rate.
+ * The cache is safe to use from several threads, and only one of them fetches a host's
+ * robots.txt at a time.
+ */
+class RobotsCache
+{
+    public:
+
+        RobotsCache(CurlManager* manager, const char* user_agent = "WebCrawler", long long ttl_ms = 24LL * 60 * 60 * 1000);
+        ~RobotsCache();
+
+        bool allowed(const std::string& url);
+        std::shared_ptr<const RobotsRules> rules_for(const std::string& url);
+
+    private:
+
+        /**
+         * @struct Entry
+         * @brief The compiled rules of a host and when they expire.
+         */
+        struct Entry
+        {
+            std::shared_ptr<const RobotsRules> rules;
+            long long expires_ms;
+        };
+
+        CurlManager* manager;
+        std::string user_agent;
+        long long ttl_ms;
+
+        std::mutex lock;
+        std::unordered_map<std::string, Entry> hosts;
+        std::unordered_map<std::string, std::shared_future<std::shared_ptr<const RobotsRules>>> fetching;
+
+        std::shared_ptr<const RobotsRules> fetch_rules(const std::string& url, const std::string& host);
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ * @enum StructuralKind
+ * @brief The bytes the StructuralScanner tracks, each with its own bitmap.
+ */
+enum StructuralKind
+{
+    LESS_THAN,          /**< '<' */
+    GREATER_THAN,       /**< '>' */
+    AMPERSAND,          /**< '&' */
+    DOUBLE_QUOTE,       /**< '"' */
+    SINGLE_QUOTE,       /**< '\'' */
+    NEWLINE,            /**< '\n' */
+    WHITESPACE,         /**< ' ', '\t', '\n', '\r' and '\f' */
+    STRUCTURAL_KIND_COUNT
+};
+
+/**
+ * @brief Returns the index of the lowest set bit, which must exist.
+ */
+inline int lowest_bit(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<int>(index);
+#else
+    int index = 0;
+    while ((bits & 1) == 0)
+    {
+        bits >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+/**
+ * @enum ScanKernel
+ * @brief The implementations of the block classifier.
+ */
+enum ScanKernel
+{
+    SCALAR_KERNEL,      /**< Portable, one byte at a time */
+    SSE2_KERNEL,        /**< 16 bytes per compare */
+    AVX2_KERNEL         /**< 32 bytes per compare, chosen at runtime when the CPU supports it */
+};
+
+/**
+ * @struct StructuralBlock
+ * @brief The bitmaps of one 64-byte block: bit i of `bits[kind]` is set when byte i is of that kind.
+ */
+struct StructuralBlock
+{
+    uint64_t bits[STRUCTURAL_KIND_COUNT];
+};
+
+/**
+ * @brief Builds the bitmap for a set of kinds, for the `tracked` kinds of a StructuralScanner.
+ */
+constexpr unsigned structural_mask(StructuralKind kind)
+{
+    return 1u << kind;
+}
+
+/**
+ * @brief Every kind, the default for a StructuralScanner.
+ */
+constexpr unsigned ALL_STRUCTURAL_KINDS = (1u << STRUCTURAL_KIND_COUNT) - 1;
+
+/**
+ * @class StructuralScanner
+ * @brief Walks the delimiter bytes of a text, classifying it 64 bytes at a time.
+ *
+ * Blocks are classified with SIMD compares into one bitmap per StructuralKind the scanner
+ * tracks, sixteen blocks per call so the kernel is dispatched once per kilobyte. `next` then
+ * returns the tracked bytes in order by clearing the lowest set bit of the block's combined
+ * bitmap, the stage-2 pattern of simdjson: each delimiter is visited once and the bytes
+ * between them are never looked at. Callers check which delimiter they got, and `seek`
+ * repositions the walk when they skip ahead. Going back before the current window classifies
+ * it again.
+ *
+ * The kernel is picked once at startup: AVX2 when the CPU supports it, SSE2 on other x86
+ * processors, and a scalar loop elsewhere.
+ */
+class StructuralScanner
+{
+    public:
+
+        static constexpr size_t BLOCK_SIZE = 64;
+        static constexpr size_t WINDOW_BLOCKS = 16;
+
+        StructuralScanner(std::string_view text = std::string_view(), unsigned tracked = ALL_STRUCTURAL_KINDS);
+        ~StructuralScanner();
+
+        void reset(std::string_view text);
+        inline void seek(size_t from);
+        inline size_t next();
+
+        static void classify(const char* data, size_t length, StructuralBlock* out, size_t blocks, unsigned tracked = ALL_STRUCTURAL_KINDS);
+        static ScanKernel get_kernel();
+        static bool set_kernel(ScanKernel kernel);
+        static const char* kernel_name(ScanKernel kernel);
+
+    private:
+
+        std::string_view text;
+        unsigned tracked;
+        size_t window_start;                    /**< The offset of the first classified block */
+        size_t window_end;                      /**< The offset past the last classified block */
+        StructuralBlock window[WINDOW_BLOCKS];
+        uint64_t window_any[WINDOW_BLOCKS];     /**< The OR of the tracked bitmaps of each block */
+
+        size_t cursor_block;                    /**< The offset of the block being walked */
+        uint64_t cursor_bits;                   /**< Its tracked bytes not yet returned by `next` */
+
+        void load(size_t block_start);
+};
+
+/**
+ * @brief Moves the walk so that `next` returns the first tracked byte at or after `from`.
+ */
+inline void StructuralScanner::seek(size_t from)
+{
+    size_t block_start = from & ~(BLOCK_SIZE - 1);
+    if (from >= this->text.size())
+    {
+        this->cursor_block = block_start;
+        this->cursor_bits = 0;
+        return;
+    }
+
+    if (block_start < this->window_start || block_start >= this->window_end)
+    {
+        this->load(block_start);
+    }
+
+    this->cursor_block = block_start;
+    this->cursor_bits = this->window_any[(block_start - this->window_start) / BLOCK_SIZE] & (~0ULL << (from - block_start));
+}
+
+/**
+ * @brief Returns the next tracked byte and moves past it.
+ *
+ * @return size_t The offset of the byte, or std::string_view::npos at the end of the text.
+ */
+inline size_t StructuralScanner::next()
+{
+    while (this->cursor_bits == 0)
+    {
+        this->cursor_block += BLOCK_SIZE;
+        if (this->cursor_block >= this->text.size())
+        {
+            this->cursor_block -= BLOCK_SIZE;
+            return std::string_view::npos;
+        }
+        if (this->cursor_block >= this->window_end)
+        {
+            this->load(this->cursor_block);
+        }
+        this->cursor_bits = this->window_any[(this->cursor_block - this->window_start) / BLOCK_SIZE];
+    }
+
+    size_t offset = this->cursor_block + lowest_bit(this->cursor_bits);
+    this->cursor_bits &= this->cursor_bits - 1;
+    return offset;
+}
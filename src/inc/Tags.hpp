@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <deque>
+#include <vector>
 
 enum TagOrganisation
 {
@@ -60,7 +62,7 @@ enum TagType
 
 
 std::string tagTypeToString(TagType tag_type);
-TagType stringToTagType(std::string tag_type);
+TagType stringToTagType(std::string_view tag_type);
 
 /**
  * @struct SingleTag
@@ -75,34 +77,167 @@ struct SingleTag
     SingleTag(TagType& tag_type, int start_open, int start_close);
     ~SingleTag();
 
-    static TagOrganisation getTagOrganisation(std::string* content, int start, int end);
+    static TagOrganisation getTagOrganisation(const std::string* content, int start, int end);
 };
 
+class TagTree;
+
 /**
  * @struct Tag
- * @brief Represents an HTML tag with its type, position, parent, and children.
+ * @brief A handle to one element of a TagTree, with its type, position, parent, and children.
+ *
+ * Tags are cheap to copy: they hold the tree and the element's index, and read its fields from
+ * the tree's arrays. A Tag whose index is TagTree::NO_TAG stands for a missing parent, child or
+ * sibling, and is false when tested.
  */
 struct Tag
 {
-    TagType* Name;               /**< The name/type of the tag */
-    int* start_open;             /**< The start position of the opening tag */
-    int* start_close;            /**< The start position of the closing tag */
-    int* end_open;               /**< The end position of the opening tag */
-    int* end_close;              /**< The end position of the closing tag */
-    Tag* Parent;                 /**< The parent tag */
-    std::deque<Tag*> Children;   /**< The child tags */
+    const TagTree* tree;         /**< The tree the tag lives in */
+    uint32_t index;              /**< The index of the tag in the tree */
+
+    inline Tag(const TagTree* tree, uint32_t index);
 
+    inline explicit operator bool() const;
 
-    Tag(TagType& name, int start_open, int start_close, int end_open, int end_close);
-    ~Tag();
+    inline TagType Name() const;
+    inline int start_open() const;
+    inline int start_close() const;
+    inline int end_open() const;
+    inline int end_close() const;
+    inline Tag Parent() const;
+    inline Tag first_child() const;
+    inline Tag next_sibling() const;
 
-    std::string getContent(std::string* html_content, int indent = 0);
+    std::string getContent(const std::string* html_content, int indent = 0) const;
 
 private:
 
-    std::string sanitizeContent(std::string& content);
-    std::string beautify_content(std::string& content);
-    std::string parse_content(std::string& content);
+    std::string sanitizeContent(const std::string& content) const;
+    std::string beautify_content(const std::string& content) const;
+    std::string parse_content(const std::string& content) const;
+};
+
+/**
+ * @class TagTree
+ * @brief The tags of a page, stored as parallel arrays indexed by element.
+ *
+ * Every element is one entry in each array: its type, the four offsets of its opening and
+ * closing tags, and the 32-bit indices of its parent, first child and next sibling. Building
+ * a page's tree is a handful of vector appends rather than several allocations per element,
+ * and walking it reads neighbouring entries of a few arrays instead of chasing pointers
+ * across the heap.
+ */
+class TagTree
+{
+    public:
+
+        static constexpr uint32_t NO_TAG = UINT32_MAX;
+
+        TagTree();
+        ~TagTree();
+
+        uint32_t add(TagType name, int start_open, int start_close);
+        void close(uint32_t tag, int end_open, int end_close);
+        void link(uint32_t parent, uint32_t previous, uint32_t child);
+        void clear();
+
+        size_t size() const;
+        size_t memory_usage() const;
+        Tag get(uint32_t tag) const;
+        Tag first_root() const;
+
+    private:
+
+        friend struct Tag;
+
+        std::vector<uint8_t> names;             /**< The TagType of each element */
+        std::vector<int32_t> start_opens;       /**< The offset of the '<' of the opening tag */
+        std::vector<int32_t> start_closes;      /**< The offset of the '>' of the opening tag */
+        std::vector<int32_t> end_opens;         /**< The offset of the '<' of the closing tag */
+        std::vector<int32_t> end_closes;        /**< The offset of the '>' of the closing tag */
+        std::vector<uint32_t> parents;          /**< NO_TAG for the roots */
+        std::vector<uint32_t> first_children;
+        std::vector<uint32_t> next_siblings;
+        uint32_t root;                          /**< The first element with no parent */
 };
 
+/**
+ * @brief Constructs a handle to the tag at `index` in `tree`.
+ */
+inline Tag::Tag(const TagTree* tree, uint32_t index)
+{
+    this->tree = tree;
+    this->index = index;
+}
+
+/**
+ * @brief Checks whether the handle refers to a tag rather than to NO_TAG.
+ */
+inline Tag::operator bool() const
+{
+    return this->index != TagTree::NO_TAG;
+}
+
+/**
+ * @brief The type of the tag.
+ */
+inline TagType Tag::Name() const
+{
+    return static_cast<TagType>(this->tree->names[this->index]);
+}
+
+/**
+ * @brief The starting position of the opening tag.
+ */
+inline int Tag::start_open() const
+{
+    return this->tree->start_opens[this->index];
+}
+
+/**
+ * @brief The ending position of the opening tag.
+ */
+inline int Tag::start_close() const
+{
+    return this->tree->start_closes[this->index];
+}
+
+/**
+ * @brief The starting position of the closing tag, -1 until the tag is closed.
+ */
+inline int Tag::end_open() const
+{
+    return this->tree->end_opens[this->index];
+}
+
+/**
+ * @brief The ending position of the closing tag, -1 until the tag is closed.
+ */
+inline int Tag::end_close() const
+{
+    return this->tree->end_closes[this->index];
+}
 
+/**
+ * @brief The tag this one is nested in.
+ */
+inline Tag Tag::Parent() const
+{
+    return Tag(this->tree, this->tree->parents[this->index]);
+}
+
+/**
+ * @brief The first tag nested in this one.
+ */
+inline Tag Tag::first_child() const
+{
+    return Tag(this->tree, this->tree->first_children[this->index]);
+}
+
+/**
+ * @brief The tag that follows this one in its parent.
+ */
+inline Tag Tag::next_sibling() const
+{
+    return Tag(this->tree, this->tree->next_siblings[this->index]);
+}
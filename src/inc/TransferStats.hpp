@@ -0,0 +1,84 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @enum TransferPhase
+ * @brief The points in a transfer timed by libcurl, each measured from the start of the transfer.
+ */
+enum TransferPhase
+{
+    NAMELOOKUP_PHASE,       /**< CURLINFO_NAMELOOKUP_TIME_T: the name was resolved */
+    CONNECT_PHASE,          /**< CURLINFO_CONNECT_TIME_T: the TCP connection was established */
+    APPCONNECT_PHASE,       /**< CURLINFO_APPCONNECT_TIME_T: the TLS handshake finished, 0 without TLS */
+    STARTTRANSFER_PHASE,    /**< CURLINFO_STARTTRANSFER_TIME_T: the first response byte arrived */
+    TOTAL_PHASE,            /**< CURLINFO_TOTAL_TIME_T: the transfer finished */
+    PHASE_COUNT
+};
+
+/**
+ * @struct TimingHistogram
+ * @brief Counts transfer timings per phase in logarithmic microsecond buckets.
+ *
+ * Each power of two is split into four equal buckets, so a bucket spans at most a quarter of
+ * its lower bound and percentiles are accurate to within 25% at any scale. Times below 4
+ * microseconds, such as the name lookup and connect of a reused connection, get a bucket
+ * each. The last bucket covers 7 * 2^29 to 2^32 microseconds, about 63 to 72 minutes, and also
+ * holds everything longer. Percentiles are reported as the upper bound of their bucket.
+ */
+struct TimingHistogram
+{
+    static const int SUB_BUCKETS = 4;
+    static const int BUCKET_COUNT = SUB_BUCKETS + 30 * SUB_BUCKETS;
+
+    uint64_t transfers = 0;                            /**< The number of transfers recorded */
+    uint32_t counts[PHASE_COUNT][BUCKET_COUNT] = {};   /**< The number of times falling in each bucket */
+    uint64_t total_us[PHASE_COUNT] = {};               /**< The sum of the times of each phase */
+
+    void add(const curl_off_t (&times_us)[PHASE_COUNT]);
+    void merge(const TimingHistogram& other);
+    double mean_ms(TransferPhase phase) const;
+    double percentile_ms(TransferPhase phase, double percentile) const;
+
+    static int bucket_for(curl_off_t time_us);
+    static uint64_t bucket_upper_us(int bucket);
+};
+
+/**
+ * @class TransferStats
+ * @brief Aggregates the libcurl timings of finished transfers, per host and overall.
+ *
+ * Recording a transfer reads its five CURLINFO times and adds them to the histogram of its
+ * host and to the global one, a few counter increments under one lock. Hosts are kept until
+ * `clear` is called, so long crawls over many hosts should clear the stats after dumping them.
+ * Safe to use from several threads.
+ */
+class TransferStats
+{
+    public:
+
+        TransferStats();
+        ~TransferStats();
+
+        void record(CURL* easy, const std::string& host);
+        void clear();
+
+        TimingHistogram global();
+        TimingHistogram host(const std::string& host);
+        std::vector<std::string> hosts();
+        void dump(std::ostream& out);
+
+    private:
+
+        std::mutex lock;
+        TimingHistogram overall;
+        std::unordered_map<std::string, TimingHistogram> per_host;
+
+        static void dump_histogram(std::ostream& out, const std::string& name, const TimingHistogram& histogram);
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <string>
+
+/**
+ * @enum FetchCode
+ * @brief Classifies the outcome of a transfer by whether trying again could succeed.
+ */
+enum FetchCode
+{
+    NO_FETCH_ERROR,
+    TRANSIENT_FETCH_ERROR,      /**< Timeouts, connection failures, 408/429/5xx responses: worth retrying */
+    PERMANENT_FETCH_ERROR,      /**< Malformed URLs, TLS verification failures, other 4xx responses: not worth retrying */
+    UNWANTED_CONTENT_TYPE,      /**< Aborted before the body because the Content-Type is not accepted */
+    BODY_TOO_LARGE              /**< Aborted because the body is larger than the configured cap */
+};
+
+/**
+ * @struct FetchResult
+ * @brief The outcome of a single transfer driven by the CurlManager.
+ */
+struct FetchResult
+{
+    std::string url;                 /**< The URL that was requested */
+    std::string* html_content;       /**< The response body, or nullptr on failure. Ownership passes to the receiver */
+    FetchCode fetch_code;            /**< Whether the transfer succeeded, and if not whether it was worth retrying */
+    CURLcode code;                   /**< The libcurl result of the transfer */
+    long status;                     /**< The HTTP status code of the response */
+    int attempts;                    /**< The number of attempts made, including retries */
+    std::string headers;             /**< The header lines of the final response, status line first, separated by CRLF */
+    curl_off_t wire_bytes;           /**< The body bytes received on the wire, before decompression */
+    size_t decoded_bytes;            /**< The body bytes after decompression */
+    bool from_cache;                 /**< Whether the body was served from the disk cache after a 304 */
+};
+
+/**
+ * @class Transport
+ * @brief Fetches a URL in a single blocking call.
+ *
+ * WebPage fetches through a Transport, so the live CurlManager can be swapped for a
+ * RecordingTransport or ReplayTransport to capture and replay the responses of a run.
+ */
+class Transport
+{
+    public:
+
+        virtual ~Transport() {}
+
+        /**
+         * @brief Sends a GET request and returns the full result of the transfer.
+         *
+         * @param url The URL to send the GET request to.
+         * @return FetchResult The result of the transfer. The caller owns its HTML content.
+         */
+        virtual FetchResult fetch(const char* url) = 0;
+};
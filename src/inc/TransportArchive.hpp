@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Transport.hpp>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @struct ArchivedResponse
+ * @brief One response as stored in a transport archive.
+ */
+struct ArchivedResponse
+{
+    std::string url;                 /**< The URL as it was requested */
+    FetchCode fetch_code;            /**< How the transfer was classified */
+    CURLcode code;                   /**< The libcurl result of the transfer */
+    long status;                     /**< The HTTP status code of the response */
+    long long elapsed_ms;            /**< How long the fetch took when it was recorded */
+    curl_off_t wire_bytes;           /**< The body bytes received on the wire */
+    std::string headers;             /**< The header lines of the response */
+    bool has_body;                   /**< Whether a body was returned, even an empty one */
+    std::string body;                /**< The response body */
+};
+
+/**
+ * @class RecordingTransport
+ * @brief Passes fetches through to another Transport and appends every result to an archive.
+ *
+ * Each response is written as one length-prefixed binary record holding the URL, outcome,
+ * status, headers, fetch time and body, and flushed straight away, so an interrupted run
+ * still leaves a usable archive. Failed fetches are recorded too, so they replay the same
+ * way. Fetches are safe from several threads.
+ */
+class RecordingTransport : public Transport
+{
+    public:
+
+        RecordingTransport(Transport* inner, const char* archive_path);
+        ~RecordingTransport();
+
+        FetchResult fetch(const char* url) override;
+        size_t recorded();
+
+    private:
+
+        Transport* inner;
+        std::ofstream archive;
+        std::mutex lock;
+        size_t records = 0;
+};
+
+/**
+ * @class ReplayTransport
+ * @brief Serves the responses of a transport archive instead of going to the network.
+ *
+ * The whole archive is loaded into memory when constructed, keyed by normalized URL. When a
+ * URL was recorded more than once, its last response is served. URLs missing from the archive
+ * fail with PERMANENT_FETCH_ERROR and CURLE_REMOTE_FILE_NOT_FOUND. By default responses are
+ * returned immediately; with `replay_timing` each one first waits as long as it took to record.
+ * Fetches are safe from several threads.
+ */
+class ReplayTransport : public Transport
+{
+    public:
+
+        ReplayTransport(const char* archive_path, bool replay_timing = false);
+        ~ReplayTransport();
+
+        FetchResult fetch(const char* url) override;
+        size_t size();
+
+    private:
+
+        bool replay_timing;
+        std::unordered_map<std::string, ArchivedResponse> responses;
+};
@@ -3,4 +3,14 @@
 #include <Logger.hpp>
 #include <CurlManager.hpp>
 
+#include <cstdint>
+#include <string>
 
+
+std::string normalize_url(const std::string& url);
+std::string url_host(const std::string& url);
+std::string url_origin(const std::string& url);
+std::string url_path(const std::string& url);
+uint64_t hash_string(const std::string& value);
+void to_lower_ascii(std::string& value);
+long long now_ms();
@@ -1,7 +1,8 @@
 #pragma once
 
 #include <Tags.hpp>
-#include <deque>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -22,6 +23,11 @@ enum ScrapeCode
 };
 
 
+struct CachedPage;
+class CurlManager;
+class Transport;
+
+
 enum WriteCode
 {
     NO_WRITE_ERROR,
@@ -39,9 +45,11 @@ class WebPage
 {
     public:
 
-        WebPage(const char* url);
+        WebPage(const char* url, Transport* transport = nullptr);
         ~WebPage();
 
+        static std::future<WebPage*> fetch_async(const char* url, bool scrape = false, CurlManager* manager = nullptr);
+
         ScrapeCode scrape();
         WriteCode write_markdown();
         std::string get_markdown();
@@ -51,17 +59,23 @@ class WebPage
 
     private:
 
+        WebPage(const std::string& url, std::string* html_content);
+        WebPage(const std::string& url, std::shared_ptr<const CachedPage> cached_page);
+
         std::string* url;
         std::string* Title;
         std::string* Description;
-        std::string* html_content;
+        std::shared_ptr<const std::string> html_content;
         std::string* markdown_content;
         bool marked_down = false;
         std::vector<WebPage> sublinks;
 
-        std::deque<Tag*> Tags;
+        TagTree Tags;
+
+        std::shared_ptr<const CachedPage> cached_page;
 
         TagParseCode parseTagTree();
+        void cache_html();
 
         wchar_t translate_entity_w(std::string entity);
         std::string translate_entity_s(std::string entity);